@@ -0,0 +1,84 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace RandomWalk::Benchmarks {
+
+// Heap allocations made by the process, counted by the operator new
+// replacements in Benchmarks.cpp
+extern std::atomic<uint64_t> allocations;
+
+// Keeps the compiler from dropping the benchmarked work
+inline volatile float sink = 0.f;
+inline void consume(float value) {
+  sink = sink + value;
+}
+
+struct Result {
+  std::string name;
+  double rate = 0;
+  // ns per item of every timed batch, sorted
+  std::vector<double> ns;
+  double allocations_per_batch = 0;
+
+  double percentile(double p) const {
+    if (ns.empty()) {
+      return 0;
+    }
+    size_t idx = (size_t)(p / 100 * (ns.size() - 1) + 0.5);
+    return ns[idx];
+  }
+};
+
+// Times batches of work. run(batch) processes one batch of items and is
+// called for warmup + batches batches, the warmup batches are not reported.
+template <typename Run>
+Result measure(const std::string& name,
+               double rate,
+               size_t batches,
+               size_t items,
+               Run run,
+               size_t warmup = 10) {
+  for (size_t b = 0; b < warmup; b++) {
+    run(b);
+  }
+  Result result;
+  result.name = name;
+  result.rate = rate;
+  result.ns.reserve(batches);
+  uint64_t allocated = 0;
+  for (size_t b = 0; b < batches; b++) {
+    uint64_t before = allocations.load(std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+    run(warmup + b);
+    auto end = std::chrono::steady_clock::now();
+    allocated += allocations.load(std::memory_order_relaxed) - before;
+    result.ns.push_back(
+        std::chrono::duration<double, std::nano>(end - start).count() / items);
+  }
+  std::sort(result.ns.begin(), result.ns.end());
+  result.allocations_per_batch = (double)allocated / batches;
+  return result;
+}
+
+inline void print_header() {
+  std::printf("%-48s %8s %9s %9s %9s %9s %10s\n", "benchmark", "rate",
+              "p50 ns", "p90 ns", "p99 ns", "max ns", "allocs/b");
+}
+
+// Per call results without a sample rate print "-" in the rate column
+inline void print(const Result& result) {
+  std::string rate =
+      result.rate > 0 ? std::to_string((long long)result.rate) : "-";
+  std::printf("%-48s %8s %9.2f %9.2f %9.2f %9.2f %10.2f\n",
+              result.name.c_str(), rate.c_str(), result.percentile(50),
+              result.percentile(90), result.percentile(99),
+              result.percentile(100), result.allocations_per_batch);
+}
+}  // namespace RandomWalk::Benchmarks
@@ -0,0 +1,475 @@
+// Micro-benchmarks of the per-sample evaluation cost. Runs the configurations
+// of Parameters.h through the legacy per-sample evaluate_position/
+// evaluate_intensity calls and through the block path of the emitter callback
+// (Engine::render), plus the hand data conversions and the waveform
+// resampling, and reports the ns per sample (or call) percentiles over the
+// timed batches together with the heap allocations per batch. Headless, on
+// Linux build with e.g.
+//   g++ -std=c++17 -O2 -I../Dependencies/Ultrahaptics3.0.0/include
+//       -I../Dependencies/Leap/include -I../KeyboardControlledStimuli
+//       Benchmarks.cpp ../KeyboardControlledStimuli/{HandTracking,Modulation,
+//       Utils}.cpp -lLeap -lUltraleapHaptics -pthread
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#ifndef _MSC_VER
+// WaveformData.hpp opens its files with the MSVC only fopen_s
+inline int fopen_s(FILE** file, const char* filename, const char* mode) {
+  *file = std::fopen(filename, mode);
+  return *file ? 0 : 1;
+}
+#endif
+
+#include "../OfflineRenderer/HandSource.hpp"
+#include "../RandomWalk/WaveformData.hpp"
+#include "Benchmark.hpp"
+#include "Engine.h"
+#include "HandTracking.h"
+#include "LeapHandConverter.hpp"
+#include "Parameters.h"
+
+#pragma region allocation counting
+namespace RandomWalk::Benchmarks {
+std::atomic<uint64_t> allocations{0};
+}
+
+namespace {
+void* allocate(std::size_t size) noexcept {
+  RandomWalk::Benchmarks::allocations.fetch_add(1, std::memory_order_relaxed);
+  return std::malloc(size ? size : 1);
+}
+void* allocate(std::size_t size, std::align_val_t alignment) noexcept {
+  RandomWalk::Benchmarks::allocations.fetch_add(1, std::memory_order_relaxed);
+  const std::size_t align = (std::size_t)alignment;
+#ifdef _MSC_VER
+  return _aligned_malloc(size ? size : 1, align);
+#else
+  // aligned_alloc wants a multiple of the alignment
+  return std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) /
+                                       align * align);
+#endif
+}
+// GCC takes the memory an operator delete frees to come from operator new,
+// and warns on std::free in every operator delete these are inlined into
+#if defined(__GNUC__) && __GNUC__ >= 11 && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void deallocate(void* memory) noexcept {
+  std::free(memory);
+}
+void deallocate(void* memory, std::align_val_t) noexcept {
+#ifdef _MSC_VER
+  _aligned_free(memory);
+#else
+  std::free(memory);
+#endif
+}
+#if defined(__GNUC__) && __GNUC__ >= 11 && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+}  // namespace
+
+// Every replaceable form, so that no allocation goes uncounted
+void* operator new(std::size_t size) {
+  if (void* memory = allocate(size)) {
+    return memory;
+  }
+  throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) {
+  return operator new(size);
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  return allocate(size);
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+  return allocate(size);
+}
+void* operator new(std::size_t size, std::align_val_t alignment) {
+  if (void* memory = allocate(size, alignment)) {
+    return memory;
+  }
+  throw std::bad_alloc();
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+  return operator new(size, alignment);
+}
+void* operator new(std::size_t size,
+                   std::align_val_t alignment,
+                   const std::nothrow_t&) noexcept {
+  return allocate(size, alignment);
+}
+void* operator new[](std::size_t size,
+                     std::align_val_t alignment,
+                     const std::nothrow_t&) noexcept {
+  return allocate(size, alignment);
+}
+void operator delete(void* memory) noexcept {
+  deallocate(memory);
+}
+void operator delete[](void* memory) noexcept {
+  deallocate(memory);
+}
+void operator delete(void* memory, std::size_t) noexcept {
+  deallocate(memory);
+}
+void operator delete[](void* memory, std::size_t) noexcept {
+  deallocate(memory);
+}
+void operator delete(void* memory, const std::nothrow_t&) noexcept {
+  deallocate(memory);
+}
+void operator delete[](void* memory, const std::nothrow_t&) noexcept {
+  deallocate(memory);
+}
+void operator delete(void* memory, std::align_val_t alignment) noexcept {
+  deallocate(memory, alignment);
+}
+void operator delete[](void* memory, std::align_val_t alignment) noexcept {
+  deallocate(memory, alignment);
+}
+void operator delete(void* memory,
+                     std::size_t,
+                     std::align_val_t alignment) noexcept {
+  deallocate(memory, alignment);
+}
+void operator delete[](void* memory,
+                       std::size_t,
+                       std::align_val_t alignment) noexcept {
+  deallocate(memory, alignment);
+}
+void operator delete(void* memory,
+                     std::align_val_t alignment,
+                     const std::nothrow_t&) noexcept {
+  deallocate(memory, alignment);
+}
+void operator delete[](void* memory,
+                       std::align_val_t alignment,
+                       const std::nothrow_t&) noexcept {
+  deallocate(memory, alignment);
+}
+#pragma endregion
+
+using namespace RandomWalk;
+using namespace RandomWalk::Benchmarks;
+using Ultrahaptics::Vector3;
+
+namespace RandomWalk::Benchmarks {
+
+struct Options {
+  std::vector<double> rates = {16000, 20000, 32000, 40000};
+  size_t batches = 200;
+  size_t interval = 64;
+  std::string filter;
+  std::string wav = "../RandomWalk/Sample_Wave.wav";
+};
+
+void print_usage() {
+  std::cout
+      << "Usage: Benchmarks [options]\n"
+         "  --rate <Hz>            sample rate, repeat for several (default\n"
+         "                         16000, 20000, 32000 and 40000)\n"
+         "  --batches <n>          timed batches per benchmark (default 200)\n"
+         "  --interval <samples>   samples per emitter callback (default 64)\n"
+         "  --filter <text>        only run benchmarks whose name contains "
+         "text\n"
+         "  --wav <path>           waveform for the resampling benchmark\n"
+         "                         (default ../RandomWalk/Sample_Wave.wav)\n";
+}
+
+// Returns 0 on success, 1 on invalid arguments
+int parse_options(int argc, char* argv[], Options& options) {
+  bool rates_given = false;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::cout << "Missing value for " << arg << std::endl;
+      return 1;
+    }
+    std::string value = argv[++i];
+    try {
+      if (arg == "--rate") {
+        if (!rates_given) {
+          options.rates.clear();
+          rates_given = true;
+        }
+        options.rates.push_back(std::stod(value));
+      } else if (arg == "--batches") {
+        options.batches = std::stoul(value);
+      } else if (arg == "--interval") {
+        options.interval = std::stoul(value);
+      } else if (arg == "--filter") {
+        options.filter = value;
+      } else if (arg == "--wav") {
+        options.wav = value;
+      } else {
+        std::cout << "Unknown argument: " << arg << std::endl;
+        return 1;
+      }
+    } catch (const std::exception&) {
+      std::cout << "Invalid value for " << arg << std::endl;
+      return 1;
+    }
+  }
+  for (double rate : options.rates) {
+    if (rate <= 0) {
+      std::cout << "Rates must be positive" << std::endl;
+      return 1;
+    }
+  }
+  if (options.batches == 0 || options.interval == 0) {
+    std::cout << "Batches and interval must be positive" << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+// The configurations as the registry and the Marianna study build them, with
+// a duration long enough that every benchmarked sample is inside the playtime
+std::vector<std::pair<std::string, std::unique_ptr<Parameters::Configuration>>>
+make_configurations() {
+  using namespace Parameters;
+  const float intensity = 1.f;
+  const int frequency = 256;
+  const float duration = 1e9f;
+  const Vector3 offset(-20.f, 0.f, 0.f);
+
+  std::vector<std::pair<std::string, std::unique_ptr<Configuration>>> configs;
+  configs.emplace_back(
+      "StaticPoint",
+      std::make_unique<StaticPoint>(intensity, frequency, duration, offset));
+  configs.emplace_back(
+      "Brush", std::make_unique<Brush>(intensity, frequency, duration, offset,
+                                       100.f, 500.f, 256.f, 512.f));
+  configs.emplace_back(
+      "Ripple",
+      std::make_unique<Ripple>(intensity, frequency, duration, offset, 50,
+                               std::make_tuple(50, 200), 10.f));
+  configs.emplace_back(
+      "Square", std::make_unique<Square>(
+                    intensity, frequency, duration, Vector3(-20.f, 0.f, 20.f),
+                    10, 10, std::make_tuple(150, 150), powf(2.f, 11.f),
+                    Square_Rendering::Random));
+  configs.emplace_back(
+      "TrackedPoint",
+      std::make_unique<TrackedPoint>(intensity, frequency, duration, offset,
+                                     FingerIdx::INDEX, BoneIdx::TIP));
+  for (auto mode : {MariannasParameterSpace::RenderMode::STATIC,
+                    MariannasParameterSpace::RenderMode::DYNAMIC}) {
+    auto config = std::make_unique<MariannasParameterSpace::Config>(
+        intensity, frequency, offset, MariannasParameterSpace::Circ(), mode);
+    config->duration(duration);
+    configs.emplace_back(mode == MariannasParameterSpace::RenderMode::STATIC
+                             ? "Marianna/Circ/static"
+                             : "Marianna/Circ/dynamic",
+                         std::move(config));
+  }
+  return configs;
+}
+
+// Samples start 10 s into the trial, away from the start of the phase
+const double start_seconds = 10;
+
+// evaluate_position(t, hand) + evaluate_intensity(t) for every sample, the
+// way the emitter callback evaluated the configurations before the block path
+Result measure_per_sample(const std::string& name,
+                          Parameters::Configuration& config,
+                          HandTracking::LeapOutput& hand,
+                          double rate,
+                          const Options& options) {
+  config.reset_playtime();
+  config.pre_hook(&hand, (int)std::lround(rate));
+  const int64_t origin = std::llround(start_seconds * rate);
+  const size_t n = options.interval;
+  return measure(name + "/per-sample", rate, options.batches, n,
+                 [&](size_t batch) {
+                   int64_t first = origin + (int64_t)(batch * n);
+                   for (size_t i = 0; i < n; i++) {
+                     Seconds t((first + (int64_t)i) / rate);
+                     Vector3 position = config.evaluate_position(t, &hand);
+                     consume(position.x + config.evaluate_intensity(t));
+                   }
+                 });
+}
+
+// Engine::render, the block evaluation of one emitter callback
+Result measure_block(const std::string& name,
+                     Parameters::Configuration& config,
+                     const HandTracking::HandMotion& motion,
+                     double rate,
+                     const Options& options) {
+  config.reset_playtime();
+  auto render = Parameters::Engine::render_for(&config);
+  const int64_t origin = std::llround(start_seconds * rate);
+  const size_t n = options.interval;
+  return measure(name, rate, options.batches, n, [&](size_t batch) {
+    int64_t first = origin + (int64_t)(batch * n);
+    render(&config, motion, first, rate, n);
+    consume(config.block.x[n - 1] + config.block.intensity[n - 1]);
+  });
+}
+
+// Leap frames of a swaying hand every 10 ms up to the first measured sample,
+// the samples follow the palm between and past them
+HandTracking::HandMotion moving_hand() {
+  Offline::SyntheticHand swaying(30.f);
+  HandTracking::HandMotion motion;
+  for (int k = HandTracking::HandMotion::capacity - 1; k >= 0; k--) {
+    double seconds = start_seconds - 0.01 * k;
+    motion.push({Parameters::Engine::sample_clock.origin() +
+                     Ultraleap::Haptics::duration_from_sec(seconds),
+                 swaying.at(seconds)});
+  }
+  return motion;
+}
+
+// HandTracking::translate_finger_output, called once per emitter callback by
+// the tracked configurations. Reported per call.
+Result measure_translate_finger_output(HandTracking::LeapOutput& hand,
+                                       const Options& options) {
+  const size_t calls = 64;
+  return measure("HandTracking::translate_finger_output", 0, options.batches,
+                 calls, [&](size_t) {
+                   for (size_t i = 0; i < calls; i++) {
+                     const HandTracking::BoneMatrix& bones =
+                         HandTracking::translate_finger_output(&hand);
+                     consume(bones[1][3].x);
+                   }
+                 });
+}
+
+// The hand as a recorded frame, the joints of each finger spaced along its
+// bone centers
+HandTracking::RecordedFrame recorded_hand(const HandTracking::LeapOutput& hand) {
+  HandTracking::RecordedFrame frame;
+  auto set = [](float(&v)[3], const Vector3& value) {
+    v[0] = value.x;
+    v[1] = value.y;
+    v[2] = value.z;
+  };
+  frame.hand_present = hand.hand_present;
+  frame.hand_is_left = hand.hand_is_left;
+  set(frame.palm_position, hand.palm_position);
+  set(frame.palm_direction, hand.palm_direction);
+  set(frame.palm_normal, hand.palm_normal);
+  set(frame.wrist_position, hand.wrist_position);
+  for (int f = 0; f < 5; f++) {
+    set(frame.joints[f][0], hand.bones[f][0]);
+    for (int b = 0; b < 4; b++) {
+      set(frame.joints[f][b + 1], hand.bones[f][b]);
+    }
+  }
+  return frame;
+}
+
+// LeapHandConverter::toElementSimpleHand, called once per tracking frame by
+// the sensation controls. A Leap::Hand is only valid with a device, so the
+// tracked hand is the recorded frame overload the controls call on the frames
+// of the HandStream, which fills all 86 floats through the transform. The
+// no-hand case returns the invalid hand early. Reported per call.
+Result measure_to_element_simple_hand(const std::string& name,
+                                      const HandTracking::RecordedFrame& frame,
+                                      const Options& options) {
+  const size_t calls = 64;
+  LeapHandConverter converter;
+  return measure(name, 0, options.batches, calls, [&](size_t) {
+    for (size_t i = 0; i < calls; i++) {
+      auto element_hand = converter.toElementSimpleHand(frame);
+      consume(element_hand.back());
+    }
+  });
+}
+
+// WaveformData::resample of the loaded waveform to rate, reported per
+// resampled output sample. Each batch resamples a fresh copy.
+Result measure_resample(const WaveformData& waveform,
+                        double rate,
+                        const Options& options) {
+  WaveformData target = waveform;
+  target.resample((unsigned int)rate);
+  const size_t samples = target.size();
+  const size_t batches = std::max<size_t>(options.batches / 20, 5);
+  return measure("WaveformData::resample", rate, batches, samples,
+                 [&](size_t) {
+                   WaveformData copy = waveform;
+                   copy.resample((unsigned int)rate);
+                   consume(copy.at(samples / 2));
+                 },
+                 1);
+}
+
+bool selected(const Options& options, const std::string& name) {
+  return options.filter.empty() ||
+         name.find(options.filter) != std::string::npos;
+}
+}  // namespace RandomWalk::Benchmarks
+
+int main(int argc, char* argv[]) {
+  Benchmarks::Options options;
+  if (Benchmarks::parse_options(argc, argv, options) > 0) {
+    Benchmarks::print_usage();
+    return 1;
+  }
+
+  Offline::SyntheticHand synthetic;
+  HandTracking::LeapOutput hand = synthetic.at(0);
+  HandTracking::HandMotion still(hand);
+  HandTracking::HandMotion moving = Benchmarks::moving_hand();
+  auto configs = Benchmarks::make_configurations();
+
+  print_header();
+  for (double rate : options.rates) {
+    for (auto& [name, config] : configs) {
+      if (Benchmarks::selected(options, name + "/per-sample")) {
+        print(Benchmarks::measure_per_sample(name, *config, hand, rate,
+                                             options));
+      }
+      if (Benchmarks::selected(options, name + "/block")) {
+        print(Benchmarks::measure_block(name + "/block", *config, still, rate,
+                                        options));
+      }
+      if (Benchmarks::selected(options, name + "/block-moving")) {
+        print(Benchmarks::measure_block(name + "/block-moving", *config,
+                                        moving, rate, options));
+      }
+    }
+  }
+
+  if (Benchmarks::selected(options, "HandTracking::translate_finger_output")) {
+    print(Benchmarks::measure_translate_finger_output(hand, options));
+  }
+  if (Benchmarks::selected(options, "LeapHandConverter::toElementSimpleHand")) {
+    print(Benchmarks::measure_to_element_simple_hand(
+        "LeapHandConverter::toElementSimpleHand",
+        Benchmarks::recorded_hand(hand), options));
+  }
+  if (Benchmarks::selected(options,
+                           "LeapHandConverter::toElementSimpleHand/no-hand")) {
+    print(Benchmarks::measure_to_element_simple_hand(
+        "LeapHandConverter::toElementSimpleHand/no-hand",
+        HandTracking::RecordedFrame(), options));
+  }
+
+  if (Benchmarks::selected(options, "WaveformData::resample")) {
+    WaveformData waveform;
+    waveform.readRiffWave(options.wav.c_str());
+    if (!waveform.isWaveformLoaded()) {
+      std::cout << "Skipping WaveformData::resample, failed to load "
+                << options.wav << std::endl;
+    } else {
+      for (double rate : options.rates) {
+        print(Benchmarks::measure_resample(waveform, rate, options));
+      }
+    }
+  }
+  return 0;
+}
@@ -13,6 +13,8 @@
 
 #include "ultraleap/haptics/streaming.hpp"
 
+#include "../KeyboardControlledStimuli/TripleBuffer.hpp"
+
 using namespace Ultraleap::Haptics;
 
 // Structure to represent output from the Leap listener
@@ -73,16 +75,17 @@ public:
             }
         }
 
-        atomic_local_hand_data.store(local_hand_data);
+        hand_data.publish(local_hand_data);
     }
 
+    // Wait-free, read by the emitter callback only
     LeapOutput getLeapOutput()
     {
-        return atomic_local_hand_data.load();
+        return hand_data.read();
     }
 
 private:
-    std::atomic<LeapOutput> atomic_local_hand_data;
+    RandomWalk::HandTracking::TripleBuffer<LeapOutput> hand_data;
 };
 
 // Structure for passing information on the type of point to create
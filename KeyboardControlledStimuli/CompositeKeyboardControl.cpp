@@ -0,0 +1,96 @@
+// Streams a Ripple around the palm together with a point tracking the index
+// finger tip, each on its own control point of one stream.
+
+#include <conio.h>
+#include <iostream>
+#include <string>
+#include <ultraleap/haptics/streaming.hpp>
+
+#include "Compositor.h"
+#include "Entries.h"
+#include "HandTracking.h"
+#include "Parameters.h"
+#include "Runtime.h"
+#include "Utils.hpp"
+
+using namespace Ultraleap::Haptics;
+
+namespace RandomWalk::Parameters::Composite {
+
+int entry(int argc, char* argv[]) {
+  Ripple ripple(1.f, 256, 100000, Ultrahaptics::Vector3(-20.f, 0.f, 0.f), 50,
+                std::make_tuple(50, 200), 10.f);
+  TrackedPoint tip(1.f, 128, 100000, Ultrahaptics::Vector3(0.f, 0.f, 0.f),
+                   FingerIdx::INDEX, BoneIdx::TIP);
+
+  Engine::Compositor compositor;
+  compositor.add(&ripple);
+  compositor.add(&tip);
+
+  // Optional lowest acceptable update rate per control point as first
+  // argument, control points are dropped from the end until it is reached
+  float min_point_rate = 0.f;
+  if (argc > 1) {
+    const std::string value = argv[1];
+    size_t end = 0;
+    try {
+      min_point_rate = std::stof(value, &end);
+    } catch (const std::exception&) {
+      end = 0;
+    }
+    if (argc > 2 || end == 0 || end != value.size() ||
+        !(min_point_rate >= 0)) {
+      std::cout << "Usage: " << argv[0] << " [min_point_rate]" << std::endl;
+      return 1;
+    }
+  }
+
+  // Declared after the compositor, so the emitter is stopped before it is
+  // destroyed
+  Streaming::Runtime runtime;
+  if (runtime.init() > 0) {
+    return 1;
+  }
+  if (compositor.negotiate(runtime.emitter(), min_point_rate) > 0) {
+    return 1;
+  }
+  runtime.listen(compositor.hand);
+
+  if (runtime.set_callback(Engine::Compositor::emitter_callback,
+                           &compositor) > 0) {
+    return 1;
+  }
+
+  // Start the array
+  runtime.start();
+
+  std::cout << "Hit ENTER to quit..." << std::endl;
+  std::cout << "Hit r to restart the stimuli" << std::endl;
+
+  while (true) {
+    std::string key;
+    key = _getch();
+
+    if (key == "\r") {
+      break;
+    }
+
+    switch (Utils::hash(key.c_str())) {
+      case Utils::hash("r"):
+        runtime.pause();
+        compositor.reset_playtime();
+        runtime.resume();
+        break;
+      default:
+        std::cout << "Command unknown: " << key << std::endl;
+        break;
+    }
+  }
+
+  // Stop the array
+  runtime.stop();
+  runtime.stats().print(std::cout);
+
+  return 0;
+}
+}  // namespace RandomWalk::Parameters::Composite
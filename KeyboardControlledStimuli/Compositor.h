@@ -0,0 +1,149 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+
+#include <ultraleap/haptics/streaming.hpp>
+
+#include "Engine.h"
+#include "HandTracking.h"
+#include "Parameters.h"
+
+namespace RandomWalk::Parameters::Engine {
+using namespace Ultraleap::Haptics;
+
+// Renders several configurations in one stream, the k-th added configuration
+// on control point k. All of them are evaluated per block through render() on
+// the same sample indices and the same hand data, which comes from the
+// compositor's own listener. Add hand to the Leap controller instead of the
+// listeners of the configurations.
+class Compositor {
+ public:
+  Compositor() = default;
+  Compositor(const Compositor&) = delete;
+  Compositor& operator=(const Compositor&) = delete;
+
+  HandTracking::LeapListening hand;
+
+  // Puts config on the next control point. Returns false if the engine cannot
+  // render its type. Call negotiate() afterwards.
+  bool add(Configuration* config) {
+    RenderFunction render = render_for(config);
+    if (render == nullptr) {
+      return false;
+    }
+    _layers.push_back({config, render});
+    return true;
+  }
+  void clear() {
+    _layers.clear();
+    _active = 0;
+  }
+  void reset_playtime() {
+    for (auto& layer : _layers) {
+      layer.config->reset_playtime();
+    }
+  }
+
+  // Sets the control point count of the emitter to the number of added
+  // configurations, with the device update rates adjusted to the maximum for
+  // that count. While the count is not supported or the resulting update
+  // rate per control point is below min_point_rate, the last configuration is
+  // left out and the next lower count is tried. Returns 0 on success, 1 after
+  // printing the reason if no count could be set, including when a single
+  // control point does not reach min_point_rate.
+  template <typename Emitter = StreamingEmitter>
+  int negotiate(Emitter& emitter, float min_point_rate = 0.f) {
+    _active = 0;
+    _point_rate = 0.f;
+    for (size_t count = _layers.size(); count > 0; count--) {
+      auto cp_res = emitter.setControlPointCount(count, AdjustRate::All);
+      if (!cp_res) {
+        std::cout << "Failed to setControlPointCount(" << count
+                  << "): " << cp_res.error().message() << std::endl;
+        continue;
+      }
+      // Every time point of the stream updates all control points
+      auto rate_res = emitter.getEmitterUpdateRate();
+      if (!rate_res) {
+        std::cout << "Failed to getEmitterUpdateRate: "
+                  << rate_res.error().message() << std::endl;
+        return 1;
+      }
+      if (rate_res.value() < min_point_rate) {
+        std::cout << count << " control points update at " << rate_res.value()
+                  << " Hz, below " << min_point_rate << " Hz" << std::endl;
+        continue;
+      }
+      _active = count;
+      _point_rate = rate_res.value();
+      std::cout << "Rendering " << _active << " of " << _layers.size()
+                << " configurations at " << _point_rate
+                << " Hz per control point" << std::endl;
+      return 0;
+    }
+    std::cout << "No control point count could be set with at least "
+              << min_point_rate << " Hz per control point" << std::endl;
+    return 1;
+  }
+
+  // Number of added configurations
+  size_t size() const { return _layers.size(); }
+  // Number of configurations rendered since the last negotiate(), the
+  // configurations beyond it are left out
+  size_t active() const { return _active; }
+  // Update rate of each control point since the last negotiate()
+  float point_rate() const { return _point_rate; }
+  Configuration* configuration(size_t k) const { return _layers[k].config; }
+
+  // Emission callback, user_pointer is the Compositor
+  template <typename Emitter = StreamingEmitter,
+            typename Interval = OutputInterval>
+  static void emitter_callback(const Emitter& emitter,
+                               Interval& interval,
+                               const LocalTimePoint& submission_deadline,
+                               void* user_pointer) {
+    Compositor* compositor = static_cast<Compositor*>(user_pointer);
+
+    const LocalDuration& period = interval.iteratorTimeInterval();
+    size_t n = 0;
+    for (auto it = interval.begin(); it != interval.end(); ++it) {
+      n++;
+    }
+    const int64_t first = sample_clock.index(interval.firstSample(), period);
+    const double rate = Time::SampleClock::rate(period);
+
+    // Get a copy of the recent hand data, shared by all control points
+    const HandTracking::HandMotion& motion = compositor->hand.getHandMotion();
+    bool hand_present = false;
+    const size_t active = compositor->_active;
+    for (size_t k = 0; k < active; k++) {
+      const Layer& layer = compositor->_layers[k];
+      hand_present = layer.render(layer.config, motion, first, rate, n);
+    }
+
+    // Loop through time, setting the data of every control point
+    size_t i = 0;
+    for (auto& sample : interval) {
+      for (size_t k = 0; k < active; k++) {
+        const SampleBlock& block = compositor->_layers[k].config->block;
+        if (hand_present) {
+          sample.controlPoint(k).setPosition(
+              Ultrahaptics::Vector3(block.x[i], block.y[i], block.z[i]));
+        }
+        sample.controlPoint(k).setIntensity(block.intensity[i]);
+      }
+      i++;
+    }
+  }
+
+ private:
+  struct Layer {
+    Configuration* config;
+    RenderFunction render;
+  };
+  std::vector<Layer> _layers;
+  size_t _active = 0;
+  float _point_rate = 0.f;
+};
+}  // namespace RandomWalk::Parameters::Engine
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <ultraleap/haptics/streaming.hpp>
+
+#include "Engine.h"
+#include "HandTracking.h"
+#include "Parameters.h"
+
+namespace RandomWalk::Parameters::Engine {
+using namespace Ultraleap::Haptics;
+
+// Samples of control point 0 as rendered for the emitter
+struct RenderedSamples {
+  SampleBlock block;
+  // Per sample whether a hand was present, only then the position is set
+  std::vector<uint8_t> hand;
+
+  void start(int64_t first, double rate, size_t n) {
+    block.start(first, rate);
+    for (size_t i = 0; i < n; i++) {
+      block.push();
+    }
+    hand.assign(n, 0);
+    std::fill_n(block.intensity.begin(), n, 0.f);
+  }
+  // Copies the samples of a rendered configuration block to sample offset on
+  void copy(const SampleBlock& from, size_t offset, bool hand_present) {
+    std::copy_n(from.x.begin(), from.size, block.x.begin() + offset);
+    std::copy_n(from.y.begin(), from.size, block.y.begin() + offset);
+    std::copy_n(from.z.begin(), from.size, block.z.begin() + offset);
+    std::copy_n(from.intensity.begin(), from.size,
+                block.intensity.begin() + offset);
+    std::fill_n(hand.begin() + offset, from.size, hand_present ? 1 : 0);
+  }
+  // Loop through time, setting control point data
+  template <typename Interval = OutputInterval>
+  void write(Interval& interval) const {
+    size_t i = 0;
+    for (auto& sample : interval) {
+      if (i >= block.size) {
+        break;
+      }
+      if (hand[i]) {
+        sample.controlPoint(0).setPosition(
+            Ultrahaptics::Vector3(block.x[i], block.y[i], block.z[i]));
+      }
+      sample.controlPoint(0).setIntensity(block.intensity[i]);
+      i++;
+    }
+  }
+};
+
+// The configuration streamed by the emitter callback, switched while the
+// emitter keeps running. A new configuration is staged from the control
+// thread and taken up by the renderer at an exact sample index, splitting the
+// interval if the index falls inside it. The replaced configuration is handed
+// back through retired() once the renderer no longer touches it, so it can be
+// destroyed without pausing the emitter.
+//
+// One control thread stages and reclaims, the rendering thread (the emitter
+// callback or a LookAhead producer) switches. The staged configuration is
+// passed through a single flag: the control thread only writes it while the
+// flag is clear, the renderer only reads it while the flag is set.
+class ConfigurationSlot {
+ public:
+  ConfigurationSlot() = default;
+  ConfigurationSlot(const ConfigurationSlot&) = delete;
+  ConfigurationSlot& operator=(const ConfigurationSlot&) = delete;
+
+  // Makes config the streamed configuration right away. Only call while the
+  // emission callback is not running, i.e. before the emitter is started.
+  // Returns false if the engine cannot render its type.
+  bool set(Configuration* config) {
+    RenderFunction render = render_for(config);
+    if (render == nullptr) {
+      return false;
+    }
+    _active = {config, render};
+    return true;
+  }
+
+  // Hands config to the emission callback, which streams it from sample index
+  // at on, or from the start of the next interval without at. Indices in the
+  // past switch at the start of the next interval. Returns false if the
+  // engine cannot render the type of config, or if the previous switch has
+  // not been taken up and reclaimed yet.
+  bool stage(Configuration* config, std::optional<int64_t> at = std::nullopt) {
+    if (_staged.load(std::memory_order_acquire) ||
+        _retired.load(std::memory_order_acquire) != nullptr) {
+      return false;
+    }
+    RenderFunction render = render_for(config);
+    if (render == nullptr) {
+      return false;
+    }
+    _next = {config, render};
+    _next_at = at;
+    _staged.store(true, std::memory_order_release);
+    return true;
+  }
+
+  // The configuration replaced by the last switch once the renderer no longer
+  // uses it, nullptr before. Each replaced configuration is returned once.
+  Configuration* retired() {
+    return _retired.exchange(nullptr, std::memory_order_acq_rel);
+  }
+  // Waits up to timeout for the staged configuration to be taken up, and
+  // returns the one it replaced, or nullptr if the switch did not happen.
+  Configuration* reclaim(std::chrono::milliseconds timeout =
+                             std::chrono::milliseconds(500)) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (true) {
+      if (Configuration* config = retired()) {
+        return config;
+      }
+      if (std::chrono::steady_clock::now() >= deadline) {
+        return nullptr;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  // The configuration rendered last. Only from the rendering thread.
+  Configuration* active() const { return _active.config; }
+  // True while a staged configuration waits for the callback
+  bool staged() const { return _staged.load(std::memory_order_acquire); }
+
+  // Index of the first sample not rendered yet, the earliest index a
+  // configuration staged now can start at
+  int64_t position() const { return _position.load(std::memory_order_acquire); }
+
+  // Renders the n samples from sample index first on into out, switching to
+  // the staged configuration at its index. Only one thread may render at a
+  // time, the emission callback or a look-ahead producer.
+  void render(int64_t first, double rate, size_t n, RenderedSamples& out) {
+    out.start(first, rate, n);
+
+    // Samples rendered by the active configuration, the staged one renders
+    // the rest
+    size_t split = n;
+    if (_staged.load(std::memory_order_acquire)) {
+      int64_t at = _next_at.value_or(first);
+      if (at < first + (int64_t)n) {
+        split = at > first ? (size_t)(at - first) : 0;
+      }
+    }
+
+    if (split > 0 && _active.config != nullptr) {
+      // The recent hand data
+      bool hand = _active.render(_active.config,
+                                 _active.config->hand.getHandMotion(), first,
+                                 rate, split);
+      out.copy(_active.config->block, 0, hand);
+    }
+    if (split < n) {
+      bool hand = _next.render(_next.config, _next.config->hand.getHandMotion(),
+                               first + split, rate, n - split);
+      out.copy(_next.config->block, split, hand);
+    }
+
+    _position.store(first + (int64_t)n, std::memory_order_release);
+    if (split < n) {
+      Configuration* replaced = _active.config;
+      _active = _next;
+      _staged.store(false, std::memory_order_release);
+      if (replaced != nullptr) {
+        _retired.store(replaced, std::memory_order_release);
+      }
+    }
+  }
+
+  // Emission callback, user_pointer is the ConfigurationSlot
+  template <typename Emitter = StreamingEmitter,
+            typename Interval = OutputInterval>
+  static void emitter_callback(const Emitter& emitter,
+                               Interval& interval,
+                               const LocalTimePoint& submission_deadline,
+                               void* user_pointer) {
+    ConfigurationSlot* slot = static_cast<ConfigurationSlot*>(user_pointer);
+
+    const LocalDuration& period = interval.iteratorTimeInterval();
+    size_t n = 0;
+    for (auto it = interval.begin(); it != interval.end(); ++it) {
+      n++;
+    }
+    slot->render(sample_clock.index(interval.firstSample(), period),
+                 Time::SampleClock::rate(period), n, slot->_out);
+    slot->_out.write(interval);
+  }
+
+ private:
+  struct Layer {
+    Configuration* config = nullptr;
+    RenderFunction render = nullptr;
+  };
+  // Owned by the rendering thread once the emitter runs
+  Layer _active;
+  // Written by stage() while _staged is clear, read by the callback while it
+  // is set
+  Layer _next;
+  std::optional<int64_t> _next_at;
+  std::atomic<bool> _staged{false};
+  std::atomic<Configuration*> _retired{nullptr};
+  std::atomic<int64_t> _position{0};
+  // Output of the emission callback
+  RenderedSamples _out;
+};
+}  // namespace RandomWalk::Parameters::Engine
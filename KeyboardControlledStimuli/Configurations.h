@@ -1,5 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+
 #include "Parameters.h"
 #include "Utils.hpp"
 
@@ -7,43 +12,30 @@ namespace RandomWalk::Configurations {
 using namespace Ultraleap::Haptics;
 using namespace RandomWalk::Parameters;
 
-using ConfigurationMap = std::map<std::string, Configuration*>;
+enum class Family { Point, Brush, Square, Ripple };
+
+// Parameters of one configuration of the registry
+struct ConfigurationSpec {
+  Family family;
+  int duration;
+  int frequency;
+  float intensity;
+};
+
+// Registry of the configurations of the random walk. Only the parameter axes
+// are stored, a configuration is addressed by its index in the product of the
+// axes and built on demand when its trial starts, so startup time and memory
+// do not grow with the number of combinations. The objects are placed in
+// arena slots that are released when the trial ends. Only the objects are:
+// their members, e.g. the point tables of a PointSequence, allocate from the
+// heap as usual.
 class Configurations {
  public:
   Configurations() {
-    std::vector<int> durations = {128, 256, 1024};
-    std::vector<int> frequencies = {32, 128, 256, 512};
-    std::vector<float> intensities = {0.4, 0.6, 0.8, 1};
-
-    float width = 100.f;
-    float height = 500.f;
-    float width_f = 256.f;
-    float height_f = 512.f;
-
-    for (auto& d : durations) {
-      for (auto& f : frequencies) {
-        for (auto& i : intensities) {
-          std::string key = "_d" + std::to_string(d) + "_f" +
-                            std::to_string(f) + "_i" + std::to_string(i);
-
-          configurations.insert(
-              {"point" + key, new StaticPoint(i, f, d, std_offset)});
-
-          configurations.insert(
-              {"brush" + key, new Brush(i, f, d, std_offset, width, height,
-                                        width_f, height_f)});
-
-          configurations.insert(
-              {"square" + key, new Square(i, f, d, Vector3({-20.f, 0.f, 20.f}),
-                                          10, 10, {150, 150}, powf(2.f, 11.f),
-                                          Square_Rendering::Random)});
-
-          configurations.insert(
-              {"ripple" + key,
-               new Ripple(i, f, d, std_offset, 50, {50, 200}, 10.f)});
-        }
-      }
-    }
+    families = {Family::Point, Family::Brush, Family::Square, Family::Ripple};
+    durations = {128, 256, 1024};
+    frequencies = {32, 128, 256, 512};
+    intensities = {0.4, 0.6, 0.8, 1};
 
     // configurations.insert({ "point", new StaticPoint(1.f, 256, 256,
     // std_offset) });
@@ -117,33 +109,161 @@ class Configurations {
      }
      */
   }
-  ConfigurationMap get_configurations() { return configurations; }
-  Configuration* get_configuration(std::string key) {
-    return configurations[key];
+  ~Configurations() { release(); }
+  Configurations(const Configurations&) = delete;
+  Configurations& operator=(const Configurations&) = delete;
+
+  int size() const {
+    return families.size() * durations.size() * frequencies.size() *
+           intensities.size();
+  }
+  // Decodes index into its parameters, intensity varies fastest
+  ConfigurationSpec get_spec(size_t index) const {
+    ConfigurationSpec spec;
+    spec.intensity = intensities[index % intensities.size()];
+    index /= intensities.size();
+    spec.frequency = frequencies[index % frequencies.size()];
+    index /= frequencies.size();
+    spec.duration = durations[index % durations.size()];
+    index /= durations.size();
+    spec.family = families[index % families.size()];
+    return spec;
+  }
+  std::string get_key(size_t index) const {
+    ConfigurationSpec spec = get_spec(index);
+    return to_string(spec.family) + "_d" + std::to_string(spec.duration) +
+           "_f" + std::to_string(spec.frequency) + "_i" +
+           std::to_string(spec.intensity);
   }
-  std::vector<std::string> get_keys(bool sorted = false) {
+  std::vector<std::string> get_keys(bool sorted = false) const {
     std::vector<std::string> keys;
-    for (auto const& cmap : configurations)
-      keys.push_back(cmap.first);
+    for (int i = 0; i < size(); i++)
+      keys.push_back(get_key(i));
     if (sorted) {
       std::sort(keys.begin(), keys.end());
     }
     return keys;
   }
-  std::tuple<std::string, Configuration*> get_random(
-      std::vector<std::string> exclude = {}) {
-    std::sort(exclude.begin(), exclude.end());
-    auto _keys = get_keys(true);
-    std::vector<std::string> keys;
-    std::set_difference(_keys.begin(), _keys.end(), exclude.begin(),
-                        exclude.end(), std::back_inserter(keys));
-    std::string r_key = *Utils::select_randomly(keys.begin(), keys.end());
-    return std::make_tuple(r_key, configurations[r_key]);
+
+  // Builds the configuration at index in the arena, releasing the one of the
+  // previous trial. The pointer stays valid until the next build or release.
+  Configuration* build(size_t index) {
+    release();
+    current = 0;
+    return build_in(slots[current], index);
+  }
+  // Builds the configuration at index next to the current one, for switching
+  // trials while the emitter keeps running. The current configuration stays
+  // valid, the one built before it is destroyed, so it must no longer be
+  // referenced by a hand listener or the emission callback.
+  Configuration* build_next(size_t index) {
+    current = 1 - current;
+    release(slots[current]);
+    return build_in(slots[current], index);
+  }
+  // Destroys the configurations of the current and the previous trial. Remove
+  // their hand listeners from the Leap controller and stop the emission
+  // callback first.
+  void release() {
+    for (auto& slot : slots) {
+      release(slot);
+    }
+  }
+  // Destroys config, once the emission callback no longer renders it
+  void release(Configuration* config) {
+    for (auto& slot : slots) {
+      if (slot.config == config) {
+        release(slot);
+      }
+    }
   }
-  int size() { return configurations.size(); }
 
  private:
-  ConfigurationMap configurations;
+  std::vector<Family> families;
+  std::vector<int> durations;
+  std::vector<int> frequencies;
+  std::vector<float> intensities;
+
+  float width = 100.f;
+  float height = 500.f;
+  float width_f = 256.f;
+  float height_f = 512.f;
+
+  // The size and alignment of the largest configuration build_in() makes,
+  // make() asserts that the one it constructs fits
+  static constexpr size_t slot_size = std::max(
+      {sizeof(StaticPoint), sizeof(Brush), sizeof(Square), sizeof(Ripple)});
+  static constexpr size_t slot_alignment = std::max(
+      {alignof(StaticPoint), alignof(Brush), alignof(Square), alignof(Ripple)});
+
+  // At most the configurations of two trials live at a time, the outgoing one
+  // and its successor. The initial buffer of a slot covers any of them, so
+  // the object itself is not allocated on the heap, its members still are.
+  struct Slot {
+    alignas(slot_alignment) std::byte buffer[slot_size];
+    std::pmr::monotonic_buffer_resource arena{buffer, sizeof(buffer)};
+    Configuration* config = nullptr;
+  };
+  Slot slots[2];
+  size_t current = 0;
+
+  void release(Slot& slot) {
+    if (slot.config != nullptr) {
+      slot.config->~Configuration();
+      slot.config = nullptr;
+    }
+    slot.arena.release();
+  }
+
+  Configuration* build_in(Slot& slot, size_t index) {
+    ConfigurationSpec spec = get_spec(index);
+    float i = spec.intensity;
+    int f = spec.frequency;
+    int d = spec.duration;
+    switch (spec.family) {
+      case Family::Point:
+        slot.config = make<StaticPoint>(slot, i, f, d, std_offset);
+        break;
+      case Family::Brush:
+        slot.config = make<Brush>(slot, i, f, d, std_offset, width, height,
+                                  width_f, height_f);
+        break;
+      case Family::Square:
+        slot.config = make<Square>(slot, i, f, d, Vector3({-20.f, 0.f, 20.f}),
+                                   10, 10, std::make_tuple(150, 150),
+                                   powf(2.f, 11.f), Square_Rendering::Random);
+        break;
+      case Family::Ripple:
+        slot.config = make<Ripple>(slot, i, f, d, std_offset, 50,
+                                   std::make_tuple(50, 200), 10.f);
+        break;
+    }
+    return slot.config;
+  }
+
+  template <typename Config, typename... Args>
+  Config* make(Slot& slot, Args&&... args) {
+    static_assert(sizeof(Config) <= slot_size &&
+                      alignof(Config) <= slot_alignment,
+                  "The configuration does not fit the buffer of a slot");
+    void* memory = slot.arena.allocate(sizeof(Config), alignof(Config));
+    return new (memory) Config(std::forward<Args>(args)...);
+  }
+
+  static std::string to_string(Family family) {
+    switch (family) {
+      case Family::Point:
+        return "point";
+      case Family::Brush:
+        return "brush";
+      case Family::Square:
+        return "square";
+      case Family::Ripple:
+        return "ripple";
+    }
+    return "";
+  }
+
   static int std_frequency;
   static float std_intensity;
   static float std_duration;
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <variant>
+
+#include <ultraleap/haptics/streaming.hpp>
+
+#include "Parameters.h"
+#include "SampleClock.hpp"
+
+// Static dispatch for the streaming path. The concrete configuration type is
+// resolved once when the callback is set, and the emitter callback is
+// instantiated per type, so every call inside the sample loop is a qualified
+// (non-virtual) call the compiler can inline. The virtual Configuration
+// interface stays in place for the websocket/JSON layer.
+namespace RandomWalk::Parameters::Engine {
+using namespace Ultraleap::Haptics;
+
+// Origin of the sample indices handed to the configurations
+inline const Time::SampleClock sample_clock;
+
+// Every concrete configuration the engine can stream. Line is streamed as
+// the Brush it derives from.
+using AnyConfiguration = std::variant<StaticPoint*,
+                                      Brush*,
+                                      Ripple*,
+                                      Square*,
+                                      TrackedPoint*,
+                                      MariannasParameterSpace::Config*>;
+
+inline std::optional<AnyConfiguration> resolve(Configuration* config) {
+  if (auto c = dynamic_cast<StaticPoint*>(config)) {
+    return c;
+  }
+  if (auto c = dynamic_cast<Brush*>(config)) {
+    return c;
+  }
+  if (auto c = dynamic_cast<Ripple*>(config)) {
+    return c;
+  }
+  if (auto c = dynamic_cast<Square*>(config)) {
+    return c;
+  }
+  if (auto c = dynamic_cast<TrackedPoint*>(config)) {
+    return c;
+  }
+  if (auto c = dynamic_cast<MariannasParameterSpace::Config*>(config)) {
+    return c;
+  }
+  return std::nullopt;
+}
+
+// Configuration::evaluate_block without virtual dispatch
+template <typename Config>
+void evaluate_block(Config& config,
+                    SampleBlock& block,
+                    HandTracking::LeapOutput* leapOutput) {
+  config.Config::evaluate_positions(block, leapOutput);
+  size_t playing = config.playing_samples(block);
+  config.Config::intensity_modulation(block, playing);
+  std::fill(block.intensity.begin() + playing,
+            block.intensity.begin() + block.size, 0.f);
+}
+
+// Evaluates n samples starting at sample index first into config.block, with
+// the positions projected onto the palm. The configuration is evaluated on
+// the hand at the time of the first sample, then every sample follows the
+// palm to its own time, so a moving hand is tracked between Leap frames.
+// Configurations that do not follow the palm are shifted by its motion within
+// the block. Returns false if no hand is present at the first sample, the
+// intensities are zero then. Samples after the hand is lost within the block
+// are silent and hold the position of the sample before. Shared by the
+// emitter callback and offline rendering, so both produce the same output for
+// the same hand data.
+template <typename Config>
+bool render(Config& config,
+            const HandTracking::HandMotion& motion,
+            int64_t first,
+            double rate,
+            size_t n) {
+  const LocalTimePoint start = sample_clock.time(first, rate);
+  HandTracking::LeapOutput leapOutput = motion.at(start);
+  config.Config::pre_hook(&leapOutput, (int)std::lround(rate));
+
+  SampleBlock& block = config.block;
+  block.start(first, rate);
+  for (size_t i = 0; i < n; i++) {
+    block.push();
+  }
+
+  if (!leapOutput.hand_present) {
+    config.reset_playtime();
+    block.fill_position(Ultrahaptics::Vector3());
+    std::fill_n(block.intensity.begin(), block.size, 0.f);
+    return false;
+  }
+
+  evaluate_block(config, block, &leapOutput);
+
+  const float side = leapOutput.hand_is_left ? -1.f : 1.f;
+  if (!motion.moving()) {
+    Ultrahaptics::Vector3 palm;
+    if (config.palm_position()) {
+      palm = leapOutput.palm_position;
+    }
+    for (size_t i = 0; i < block.size; i++) {
+      block.x[i] = palm.x + block.x[i] * side;
+      block.y[i] = palm.y + block.y[i] * side;
+      block.z[i] = palm.z + block.z[i] * side;
+    }
+    return true;
+  }
+
+  Ultrahaptics::Vector3 anchor;
+  if (!config.palm_position()) {
+    anchor = leapOutput.palm_position;
+  }
+  const double period = 1e9 / rate;
+  for (size_t i = 0; i < block.size; i++) {
+    std::optional<Ultrahaptics::Vector3> palm_at =
+        motion.palm_at(start + LocalDuration(std::llround(i * period)));
+    if (!palm_at) {
+      // The hand at the first sample is present, so i > 0
+      block.x[i] = block.x[i - 1];
+      block.y[i] = block.y[i - 1];
+      block.z[i] = block.z[i - 1];
+      block.intensity[i] = 0.f;
+      continue;
+    }
+    Ultrahaptics::Vector3 palm = palm_at.value() - anchor;
+    block.x[i] = palm.x + block.x[i] * side;
+    block.y[i] = palm.y + block.y[i] * side;
+    block.z[i] = palm.z + block.z[i] * side;
+  }
+  return true;
+}
+
+// Callback function for filling out complete device output states through
+// time, user_pointer is the Configuration* of a Config
+template <typename Config,
+          typename Emitter = StreamingEmitter,
+          typename Interval = OutputInterval>
+void emitter_callback(const Emitter& emitter,
+                      Interval& interval,
+                      const LocalTimePoint& submission_deadline,
+                      void* user_pointer) {
+  Config* config =
+      static_cast<Config*>(static_cast<Configuration*>(user_pointer));
+
+  // The sample rate follows from the spacing of the interval's time points
+  const LocalDuration& period = interval.iteratorTimeInterval();
+  size_t n = 0;
+  for (auto it = interval.begin(); it != interval.end(); ++it) {
+    n++;
+  }
+
+  // Get a copy of the recent hand data.
+  const HandTracking::HandMotion& motion = config->hand.getHandMotion();
+  bool hand_present =
+      render(*config, motion,
+             sample_clock.index(interval.firstSample(), period),
+             Time::SampleClock::rate(period), n);
+
+  // Loop through time, setting control point data
+  const SampleBlock& block = config->block;
+  size_t i = 0;
+  for (auto& sample : interval) {
+    if (hand_present) {
+      sample.controlPoint(0).setPosition(
+          Ultrahaptics::Vector3(block.x[i], block.y[i], block.z[i]));
+    }
+    sample.controlPoint(0).setIntensity(block.intensity[i]);
+    i++;
+  }
+}
+
+// render() for the concrete type of config, or nullptr if the type is unknown
+// to the engine
+using RenderFunction = bool (*)(Configuration*,
+                                const HandTracking::HandMotion&,
+                                int64_t,
+                                double,
+                                size_t);
+
+inline RenderFunction render_for(Configuration* config) {
+  auto resolved = resolve(config);
+  if (!resolved) {
+    return nullptr;
+  }
+  return std::visit(
+      [](auto* c) -> RenderFunction {
+        using Config = std::remove_pointer_t<decltype(c)>;
+        return [](Configuration* config,
+                  const HandTracking::HandMotion& motion, int64_t first,
+                  double rate, size_t n) {
+          return render(*static_cast<Config*>(config), motion, first, rate, n);
+        };
+      },
+      resolved.value());
+}
+
+// A copy of config of its concrete type, or nullptr if the type is unknown to
+// the engine. Renders like config from the state config is in.
+inline std::unique_ptr<Configuration> copy_of(Configuration* config) {
+  auto resolved = resolve(config);
+  if (!resolved) {
+    return nullptr;
+  }
+  return std::visit(
+      [](auto* c) -> std::unique_ptr<Configuration> {
+        using Config = std::remove_pointer_t<decltype(c)>;
+        return std::make_unique<Config>(*c);
+      },
+      resolved.value());
+}
+
+// The emitter callback instantiated for the concrete type of config, or
+// nullptr if the type is unknown to the engine
+inline EmissionCallback callback_for(Configuration* config) {
+  auto resolved = resolve(config);
+  if (!resolved) {
+    return nullptr;
+  }
+  return std::visit(
+      [](auto* c) -> EmissionCallback {
+        using Config = std::remove_pointer_t<decltype(c)>;
+        return &emitter_callback<Config>;
+      },
+      resolved.value());
+}
+}  // namespace RandomWalk::Parameters::Engine
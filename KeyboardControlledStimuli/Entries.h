@@ -20,6 +20,10 @@ namespace RandomWalk::Parameters {
 int entry(int argc, char* argv[]);
 }
 
+namespace RandomWalk::Parameters::Composite {
+int entry(int argc, char* argv[]);
+}
+
 namespace RandomWalk::Parameters::Websockets {
 int entry(int argc, char* argv[]);
 }
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include <ultraleap/haptics/vector3.hpp>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323
+#endif
+
+namespace RandomWalk::HandTracking {
+
+// Smooths the tracked points of a hand frame by frame and predicts them
+// latency seconds ahead, to land the focal point where the hand is rather
+// than where the tracker saw it. Updated once per tracker frame in place,
+// with a constant cost per point. The points are the same ones in the same
+// order every frame, at most max_points of them.
+//
+// The prediction owns the latency compensation: a filtered frame stands for
+// the hand at its time plus latency, and LeapListening stamps it so. Hand
+// motion sampling only extrapolates past that.
+//
+// Frames further apart than max_gap, without a hand or with the other hand
+// start the filter over.
+class HandFilter {
+ public:
+  static constexpr size_t max_points = 32;
+  static constexpr double max_gap = 0.25;
+
+  explicit HandFilter(double latency) : _latency(latency) {}
+  virtual ~HandFilter() = default;
+
+  // Filters the n points of the frame at time seconds in place. Returns
+  // false and leaves them as they are if the frame has no hand.
+  bool filter(double time,
+              bool hand_present,
+              bool hand_is_left,
+              Ultrahaptics::Vector3* points,
+              size_t n) {
+    if (!hand_present || n > max_points) {
+      _started = false;
+      return false;
+    }
+    double dt = time - _time;
+    if (!_started || hand_is_left != _left || dt > max_gap || dt < 0) {
+      start(points, n);
+      _started = true;
+      _left = hand_is_left;
+      _time = time;
+      return true;
+    }
+    if (dt > 0) {
+      update(dt, points, n);
+      _time = time;
+    } else {
+      // The same frame again, repeat the last estimate
+      estimate(points, n);
+    }
+    return true;
+  }
+  void reset() { _started = false; }
+
+  double latency() const { return _latency; }
+
+ protected:
+  // Takes the first frame as it is
+  virtual void start(Ultrahaptics::Vector3* points, size_t n) = 0;
+  // Moves dt seconds on to the frame and writes the estimate into points
+  virtual void update(double dt, Ultrahaptics::Vector3* points, size_t n) = 0;
+  // Writes the last estimate into points
+  virtual void estimate(Ultrahaptics::Vector3* points, size_t n) const = 0;
+
+  double _latency;
+
+ private:
+  bool _started = false;
+  bool _left = false;
+  double _time = 0.0;
+};
+
+// One Euro filter (Casiez et al., 2012) per point: a low pass whose cutoff
+// rises with the speed of the point, so a still hand is smoothed strongly and
+// a moving one follows with little lag. The speed estimate also predicts the
+// point forward. Positions in mm, cutoffs in Hz, beta in 1 / mm.
+class OneEuroFilter : public HandFilter {
+ public:
+  struct Parameters {
+    double min_cutoff = 1.0;
+    double beta = 0.05;
+    double derivative_cutoff = 1.0;
+  };
+
+  explicit OneEuroFilter(double latency = 0.0) : HandFilter(latency) {}
+  OneEuroFilter(double latency, Parameters parameters)
+      : HandFilter(latency), _parameters(parameters) {}
+
+ protected:
+  void start(Ultrahaptics::Vector3* points, size_t n) override {
+    for (size_t i = 0; i < n; i++) {
+      _position[i] = points[i];
+      _measured[i] = points[i];
+      _velocity[i] = Ultrahaptics::Vector3();
+    }
+  }
+
+  void update(double dt, Ultrahaptics::Vector3* points, size_t n) override {
+    // The speed of the measurements rather than of the smoothed points, which
+    // would count their lag as speed and overshoot the prediction
+    const float derivative_alpha = alpha(_parameters.derivative_cutoff, dt);
+    for (size_t i = 0; i < n; i++) {
+      Ultrahaptics::Vector3 velocity = (points[i] - _measured[i]) * (1.f / dt);
+      _measured[i] = points[i];
+      _velocity[i] += (velocity - _velocity[i]) * derivative_alpha;
+      double cutoff =
+          _parameters.min_cutoff + _parameters.beta * _velocity[i].length();
+      _position[i] += (points[i] - _position[i]) * alpha(cutoff, dt);
+    }
+    estimate(points, n);
+  }
+
+  void estimate(Ultrahaptics::Vector3* points, size_t n) const override {
+    for (size_t i = 0; i < n; i++) {
+      points[i] = _position[i] + _velocity[i] * (float)_latency;
+    }
+  }
+
+ private:
+  Parameters _parameters;
+  std::array<Ultrahaptics::Vector3, max_points> _position;
+  std::array<Ultrahaptics::Vector3, max_points> _measured;
+  std::array<Ultrahaptics::Vector3, max_points> _velocity;
+
+  // Smoothing factor of an exponential low pass at cutoff Hz
+  static float alpha(double cutoff, double dt) {
+    double tau = 1.0 / (2 * M_PI * cutoff);
+    return (float)(1.0 / (1.0 + tau / dt));
+  }
+};
+
+// Constant velocity Kalman filter per point. Every point and axis sees the
+// same frame times and noise, so they share one covariance, which costs the
+// same as a single scalar filter per frame. process_noise is the spectral
+// density of the white acceleration in mm^2 / s^3, measurement_noise the
+// variance of the tracker jitter in mm^2.
+class KalmanFilter : public HandFilter {
+ public:
+  struct Parameters {
+    double process_noise = 2e4;
+    double measurement_noise = 1.0;
+  };
+
+  explicit KalmanFilter(double latency = 0.0) : HandFilter(latency) {}
+  KalmanFilter(double latency, Parameters parameters)
+      : HandFilter(latency), _parameters(parameters) {}
+
+ protected:
+  void start(Ultrahaptics::Vector3* points, size_t n) override {
+    for (size_t i = 0; i < n; i++) {
+      _position[i] = points[i];
+      _velocity[i] = Ultrahaptics::Vector3();
+    }
+    // Unknown velocity, the position as good as a measurement
+    _pp = _parameters.measurement_noise;
+    _pv = 0.0;
+    _vv = 1e6;
+  }
+
+  void update(double dt, Ultrahaptics::Vector3* points, size_t n) override {
+    // Predict the covariance dt ahead
+    const double q = _parameters.process_noise;
+    double pp = _pp + dt * (2 * _pv + dt * _vv) + q * dt * dt * dt / 3;
+    double pv = _pv + dt * _vv + q * dt * dt / 2;
+    double vv = _vv + q * dt;
+    // Gains of the position measurement
+    const double s = pp + _parameters.measurement_noise;
+    const float position_gain = (float)(pp / s);
+    const float velocity_gain = (float)(pv / s);
+    _pp = pp - pp * pp / s;
+    _pv = pv - pp * pv / s;
+    _vv = vv - pv * pv / s;
+
+    for (size_t i = 0; i < n; i++) {
+      Ultrahaptics::Vector3 predicted = _position[i] + _velocity[i] * (float)dt;
+      Ultrahaptics::Vector3 innovation = points[i] - predicted;
+      _position[i] = predicted + innovation * position_gain;
+      _velocity[i] += innovation * velocity_gain;
+    }
+    estimate(points, n);
+  }
+
+  void estimate(Ultrahaptics::Vector3* points, size_t n) const override {
+    for (size_t i = 0; i < n; i++) {
+      points[i] = _position[i] + _velocity[i] * (float)_latency;
+    }
+  }
+
+ private:
+  Parameters _parameters;
+  std::array<Ultrahaptics::Vector3, max_points> _position;
+  std::array<Ultrahaptics::Vector3, max_points> _velocity;
+  // Covariance of position and velocity
+  double _pp = 0.0;
+  double _pv = 0.0;
+  double _vv = 0.0;
+};
+
+// The filter called name, "one-euro" or "kalman", predicting latency seconds
+// ahead. nullptr for "none" and unknown names.
+inline std::unique_ptr<HandFilter> make_hand_filter(const std::string& name,
+                                                    double latency) {
+  if (name == "one-euro") {
+    return std::make_unique<OneEuroFilter>(latency);
+  }
+  if (name == "kalman") {
+    return std::make_unique<KalmanFilter>(latency);
+  }
+  return nullptr;
+}
+inline bool is_hand_filter(const std::string& name) {
+  return name == "none" || name == "one-euro" || name == "kalman";
+}
+}  // namespace RandomWalk::HandTracking
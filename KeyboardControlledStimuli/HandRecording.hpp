@@ -0,0 +1,341 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <Leap.h>
+
+#include "HandTracking.h"
+
+namespace RandomWalk::HandTracking {
+
+// The first hand of one Leap frame as stored in a hand recording. The joints
+// are those of LeapHandConverter: per finger, thumb to pinky, the base of the
+// metacarpal and the ends of the four bones, so both the bone centers of a
+// LeapOutput and the ElementSimpleHand of the sensations follow from them.
+// Positions in Leap space, mm.
+struct RecordedFrame {
+  // Frame::timestamp(), microseconds on the Leap clock
+  int64_t timestamp = 0;
+  uint8_t hand_present = 0;
+  uint8_t hand_is_left = 0;
+  uint8_t reserved[2] = {};
+  float palm_position[3] = {};
+  float palm_direction[3] = {};
+  float palm_normal[3] = {};
+  float wrist_position[3] = {};
+  float joints[5][5][3] = {};
+
+  static RecordedFrame from(const Leap::Frame& frame) {
+    RecordedFrame recorded;
+    recorded.timestamp = frame.timestamp();
+    Leap::HandList hands = frame.hands();
+    if (hands.isEmpty() || !hands[0].isValid()) {
+      return recorded;
+    }
+    Leap::Hand hand = hands[0];
+    recorded.hand_present = 1;
+    recorded.hand_is_left = hand.isLeft() ? 1 : 0;
+    set(recorded.palm_position, hand.palmPosition());
+    set(recorded.palm_direction, hand.direction());
+    set(recorded.palm_normal, hand.palmNormal());
+    set(recorded.wrist_position, hand.wristPosition());
+    int finger_index = 0;
+    for (const Leap::Finger& finger : hand.fingers()) {
+      if (finger_index == 5) {
+        break;
+      }
+      set(recorded.joints[finger_index][0],
+          finger.bone(Leap::Bone::TYPE_METACARPAL).prevJoint());
+      for (int bone = 0; bone < 4; bone++) {
+        set(recorded.joints[finger_index][bone + 1],
+            finger.bone((Leap::Bone::Type)bone).nextJoint());
+      }
+      finger_index++;
+    }
+    return recorded;
+  }
+
+  // The hand as LeapListening::onFrame() publishes it
+  LeapOutput output() const {
+    LeapOutput output;
+    if (!hand_present) {
+      return output;
+    }
+    output.palm_position = vector(palm_position);
+    output.palm_direction = vector(palm_direction);
+    // Negated like in onFrame(), the Leap normal points down
+    output.palm_normal = vector(palm_normal) * -1.f;
+    output.wrist_position = vector(wrist_position);
+    for (int f = 0; f < 5; f++) {
+      for (int b = 0; b < 4; b++) {
+        output.bones[f][b] =
+            (vector(joints[f][b]) + vector(joints[f][b + 1])) * 0.5f;
+      }
+    }
+    output.hand_present = true;
+    output.hand_is_left = hand_is_left != 0;
+    return output;
+  }
+
+  // Filters the palm and the joints in place, see HandFilter. The directions
+  // are left unnormalized, as the recorded ones are read by their direction.
+  void filter(HandFilter& hand_filter) {
+    float(*vectors[])[3] = {&palm_position, &palm_direction, &palm_normal,
+                            &wrist_position};
+    Ultrahaptics::Vector3 points[29];
+    for (int i = 0; i < 4; i++) {
+      points[i] = vector(*vectors[i]);
+    }
+    for (int j = 0; j < 25; j++) {
+      points[4 + j] = vector(joints[j / 5][j % 5]);
+    }
+    if (!hand_filter.filter(timestamp * 1e-6, hand_present != 0,
+                            hand_is_left != 0, points, 29)) {
+      return;
+    }
+    for (int i = 0; i < 4; i++) {
+      set(*vectors[i], points[i]);
+    }
+    for (int j = 0; j < 25; j++) {
+      set(joints[j / 5][j % 5], points[4 + j]);
+    }
+  }
+
+  static Ultrahaptics::Vector3 vector(const float (&v)[3]) {
+    return Ultrahaptics::Vector3(v[0], v[1], v[2]);
+  }
+
+ private:
+  static void set(float (&to)[3], const Leap::Vector& v) {
+    to[0] = v.x;
+    to[1] = v.y;
+    to[2] = v.z;
+  }
+  static void set(float (&to)[3], const Ultrahaptics::Vector3& v) {
+    to[0] = v.x;
+    to[1] = v.y;
+    to[2] = v.z;
+  }
+};
+static_assert(std::is_trivially_copyable_v<RecordedFrame>,
+              "RecordedFrame is written to recordings as is");
+static_assert(sizeof(RecordedFrame) == 360, "Recording frame layout changed");
+
+// A hand recording is a header followed by the frames back to back, as laid
+// out in memory on the little-endian machines the Leap runs on
+struct RecordingHeader {
+  char magic[4] = {'R', 'W', 'H', 'T'};
+  uint32_t version = 1;
+  uint32_t frame_size = sizeof(RecordedFrame);
+};
+
+// Reads the frames of the recording at path into frames. Returns false and
+// prints the reason if it could not be read.
+inline bool load_recording(const std::string& path,
+                           std::vector<RecordedFrame>& frames) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    std::cout << "Failed to open hand recording: " << path << std::endl;
+    return false;
+  }
+  RecordingHeader expected;
+  RecordingHeader header;
+  file.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!file || std::memcmp(header.magic, expected.magic, 4) != 0 ||
+      header.version != expected.version ||
+      header.frame_size != expected.frame_size) {
+    std::cout << "Not a hand recording: " << path << std::endl;
+    return false;
+  }
+  frames.clear();
+  RecordedFrame frame;
+  while (file.read(reinterpret_cast<char*>(&frame), sizeof(frame))) {
+    frames.push_back(frame);
+  }
+  if (frames.empty()) {
+    std::cout << "Empty hand recording: " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Records the frames of the Leap controller it listens to, i.e. the stream
+// seen by the LeapListening and FrameListener listeners of the same
+// controller. Remove it from the controller before it is closed.
+class HandRecorder : public Leap::Listener {
+ public:
+  HandRecorder() = default;
+  HandRecorder(const HandRecorder&) = delete;
+  HandRecorder& operator=(const HandRecorder&) = delete;
+
+  // Returns false and prints the reason if path could not be created
+  bool open(const std::string& path) {
+    _file.open(path, std::ios::binary | std::ios::trunc);
+    if (!_file) {
+      std::cout << "Failed to create hand recording: " << path << std::endl;
+      return false;
+    }
+    RecordingHeader header;
+    _file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    return true;
+  }
+  void close() { _file.close(); }
+
+  void onFrame(const Leap::Controller& controller) override {
+    record(RecordedFrame::from(controller.frame()));
+  }
+  void record(const RecordedFrame& frame) {
+    if (_file.is_open()) {
+      _file.write(reinterpret_cast<const char*>(&frame), sizeof(frame));
+      _frames.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  uint64_t frames() const { return _frames.load(std::memory_order_relaxed); }
+
+ private:
+  std::ofstream _file;
+  std::atomic<uint64_t> _frames{0};
+};
+
+// Plays a hand recording into LeapListening listeners and frame callbacks in
+// place of the Leap controller, on its own thread. The frames keep their
+// recorded spacing divided by speed, speed 0 plays them back to back. With
+// loop the recording starts over once played. The frames are stamped on the
+// clock, e.g. the clock of a mock emitter, so a replay at speed 1 on an
+// accelerated emitter is accelerated along with it.
+class HandReplay {
+ public:
+  using Clock = std::function<Ultraleap::Haptics::LocalTimePoint()>;
+  using FrameCallback = std::function<void(const RecordedFrame&)>;
+
+  struct Options {
+    double speed = 1.0;
+    bool loop = false;
+    Clock clock = [] { return Ultraleap::Haptics::LocalTimeClock::now(); };
+  };
+
+  HandReplay(std::vector<RecordedFrame> frames, Options options)
+      : _frames(std::move(frames)), _options(std::move(options)) {}
+  ~HandReplay() { stop(); }
+  HandReplay(const HandReplay&) = delete;
+  HandReplay& operator=(const HandReplay&) = delete;
+
+  // Adds listener, it gets the frame played last right away. All frames are
+  // pushed under one lock, so each listener has one writer at a time.
+  void listen(LeapListening& listener) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_played > 0) {
+      listener.push(_last);
+    }
+    _listeners.push_back(&listener);
+  }
+  void unlisten(LeapListening& listener) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _listeners.erase(
+        std::remove(_listeners.begin(), _listeners.end(), &listener),
+        _listeners.end());
+  }
+  // Called with every played frame, before the listeners get it
+  void on_frame(FrameCallback callback) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _callbacks.push_back(std::move(callback));
+  }
+
+  void start() {
+    if (_running.exchange(true)) {
+      return;
+    }
+    _finished = false;
+    _thread = std::thread(&HandReplay::run, this);
+  }
+  void stop() {
+    if (_running.exchange(false)) {
+      _thread.join();
+    }
+  }
+  // True once a replay without loop played its last frame
+  bool finished() const { return _finished.load(); }
+  uint64_t played() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _played;
+  }
+
+ private:
+  const std::vector<RecordedFrame> _frames;
+  const Options _options;
+  mutable std::mutex _mutex;
+  std::vector<LeapListening*> _listeners;
+  std::vector<FrameCallback> _callbacks;
+  HandFrame _last;
+  uint64_t _played = 0;
+  std::thread _thread;
+  std::atomic<bool> _running{false};
+  std::atomic<bool> _finished{false};
+
+  void run() {
+    using Ultraleap::Haptics::LocalDuration;
+    using Ultraleap::Haptics::LocalTimePoint;
+    if (_frames.empty()) {
+      _finished = true;
+      return;
+    }
+    // A loop lasts the recording plus the spacing of its first two frames
+    const int64_t first = _frames.front().timestamp;
+    const int64_t spacing = _frames.size() > 1
+                                ? _frames[1].timestamp - first
+                                : 0;
+    const int64_t length = _frames.back().timestamp - first + spacing;
+    const LocalTimePoint start = _options.clock();
+    int64_t offset = 0;
+
+    while (_running) {
+      for (const RecordedFrame& frame : _frames) {
+        LocalTimePoint due = start;
+        if (_options.speed > 0.0) {
+          due += std::chrono::duration_cast<LocalDuration>(
+              std::chrono::duration<double, std::micro>(
+                  (frame.timestamp - first + offset) / _options.speed));
+          LocalTimePoint now;
+          while (_running && (now = _options.clock()) < due) {
+            std::this_thread::sleep_for(
+                std::min<LocalDuration>(due - now,
+                                        std::chrono::microseconds(500)));
+          }
+        } else {
+          due = _options.clock();
+        }
+        if (!_running) {
+          return;
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (const FrameCallback& callback : _callbacks) {
+          callback(frame);
+        }
+        _last = {due, frame.output()};
+        for (LeapListening* listener : _listeners) {
+          listener->push(_last);
+        }
+        _played++;
+      }
+      if (!_options.loop) {
+        _finished = true;
+        return;
+      }
+      offset += length;
+    }
+  }
+};
+}  // namespace RandomWalk::HandTracking
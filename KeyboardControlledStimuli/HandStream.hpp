@@ -0,0 +1,248 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <Leap.h>
+
+#include "HandRecording.hpp"
+#include "HandTracking.h"
+
+namespace RandomWalk::HandTracking {
+
+// Where the hand data of a run comes from and where it is recorded to, given
+// on the command line for every mode
+struct HandOptions {
+  // --record-hand <path>: record the Leap frames
+  std::string record;
+  // --replay-hand <path>: play a recording instead of the Leap
+  std::string replay;
+  // --replay-speed <x>: 1 is real time, 0 as fast as possible
+  double replay_speed = 1.0;
+  // --replay-loop: start the recording over once played
+  bool replay_loop = false;
+  // --hand-filter <none|one-euro|kalman>: smooth the tracked hand
+  std::string filter = "none";
+  // --predict-ms <ms>: predict the filtered hand this far ahead, to make up
+  // for the tracking and emitter delay not covered by the frame times
+  double predict_ms = 0.0;
+
+  // A filter for one consumer of the hand data, nullptr without
+  std::unique_ptr<HandFilter> make_filter() const {
+    return make_hand_filter(filter, predict_ms * 1e-3);
+  }
+};
+
+// The options of this run
+inline HandOptions& hand_options() {
+  static HandOptions options;
+  return options;
+}
+
+inline void print_hand_options_usage(std::ostream& out) {
+  out << "Hand options, before the mode:" << std::endl
+      << "  --record-hand <path>\trecord the Leap frames" << std::endl
+      << "  --replay-hand <path>\tplay a hand recording instead of the Leap"
+      << std::endl
+      << "  --replay-speed <x>\treplay speed, 0 as fast as possible "
+         "(default 1)"
+      << std::endl
+      << "  --replay-loop\t\trepeat the hand recording" << std::endl
+      << "  --hand-filter <f>\tnone, one-euro or kalman (default none)"
+      << std::endl
+      << "  --predict-ms <ms>\tpredict the filtered hand ahead (default 0)"
+      << std::endl;
+}
+
+// Takes the hand options from the front of argv into hand_options(), moving
+// the remaining arguments up. Returns 1 after printing the reason if a value
+// is missing or invalid.
+inline int take_hand_options(int& argc, char* argv[]) {
+  HandOptions& options = hand_options();
+  int i = 1;
+  for (; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--replay-loop") {
+      options.replay_loop = true;
+      continue;
+    }
+    if (arg != "--record-hand" && arg != "--replay-hand" &&
+        arg != "--replay-speed" && arg != "--hand-filter" &&
+        arg != "--predict-ms") {
+      break;
+    }
+    if (i + 1 >= argc) {
+      std::cout << "Missing value for " << arg << std::endl;
+      return 1;
+    }
+    const std::string value = argv[++i];
+    if (arg == "--record-hand") {
+      options.record = value;
+    } else if (arg == "--replay-hand") {
+      options.replay = value;
+    } else if (arg == "--hand-filter") {
+      if (!is_hand_filter(value)) {
+        std::cout << "Invalid value for " << arg << std::endl;
+        return 1;
+      }
+      options.filter = value;
+    } else {
+      double& number =
+          arg == "--predict-ms" ? options.predict_ms : options.replay_speed;
+      size_t end = 0;
+      try {
+        number = std::stod(value, &end);
+      } catch (const std::exception&) {
+        end = 0;
+      }
+      if (end != value.size() || number < 0) {
+        std::cout << "Invalid value for " << arg << std::endl;
+        return 1;
+      }
+    }
+  }
+  // The mode and its arguments follow the program name
+  std::copy(argv + i, argv + argc, argv + 1);
+  argc -= i - 1;
+  return 0;
+}
+
+// The hand data of an entry: the frames of the Leap controller, or a hand
+// recording played in its place, given to LeapListening listeners and frame
+// callbacks. With a record path the Leap frames are recorded as well. With a
+// hand filter every listener and callback filters the frames it gets on its
+// own, the recording keeps them raw.
+//
+// Declare the stream after the listeners it is given, it removes them when
+// destroyed.
+class HandStream {
+ public:
+  using FrameCallback = HandReplay::FrameCallback;
+
+  explicit HandStream(const HandOptions& options = hand_options())
+      : _options(options) {}
+  HandStream(const HandStream&) = delete;
+  HandStream& operator=(const HandStream&) = delete;
+  ~HandStream() {
+    stop();
+    if (_leap) {
+      for (Leap::Listener* listener : _listeners) {
+        _leap->removeListener(*listener);
+      }
+      _leap->removeListener(_recorder);
+    }
+    _recorder.close();
+  }
+
+  // Connects to the Leap, or loads the recording to replay. Returns 0 on
+  // success, 1 after printing the reason.
+  int open() {
+    if (!_options.replay.empty()) {
+      std::vector<RecordedFrame> frames;
+      if (!load_recording(_options.replay, frames)) {
+        return 1;
+      }
+      std::cout << "Replaying " << frames.size() << " hand frames from "
+                << _options.replay << std::endl;
+      HandReplay::Options replay_options;
+      replay_options.speed = _options.replay_speed;
+      replay_options.loop = _options.replay_loop;
+      _replay = std::make_unique<HandReplay>(std::move(frames),
+                                             std::move(replay_options));
+      if (!_options.record.empty()) {
+        std::cout << "Not recording the replayed hand" << std::endl;
+      }
+      return 0;
+    }
+    _leap = std::make_unique<LeapController>();
+    if (!_options.record.empty()) {
+      if (!_recorder.open(_options.record)) {
+        return 1;
+      }
+      _leap->addListener(_recorder);
+      std::cout << "Recording the hand to " << _options.record << std::endl;
+    }
+    return 0;
+  }
+  bool replaying() const { return _replay != nullptr; }
+
+  void listen(LeapListening& listener) {
+    listener.set_filter(_options.make_filter());
+    if (_replay) {
+      _replay->listen(listener);
+    } else {
+      _leap->addListener(listener);
+      _listeners.push_back(&listener);
+    }
+  }
+  void unlisten(LeapListening& listener) {
+    if (_replay) {
+      _replay->unlisten(listener);
+    } else {
+      _leap->removeListener(listener);
+      _listeners.erase(
+          std::remove(_listeners.begin(), _listeners.end(), &listener),
+          _listeners.end());
+    }
+  }
+  // Calls callback with every frame of either source, on the Leap or replay
+  // thread
+  void on_frame(FrameCallback callback) {
+    std::shared_ptr<HandFilter> filter = _options.make_filter();
+    if (filter) {
+      callback = [filter, callback = std::move(callback)](
+                     const RecordedFrame& frame) {
+        RecordedFrame filtered = frame;
+        filtered.filter(*filter);
+        callback(filtered);
+      };
+    }
+    if (_replay) {
+      _replay->on_frame(std::move(callback));
+    } else {
+      _callbacks.push_back(
+          std::make_unique<CallbackListener>(std::move(callback)));
+      _leap->addListener(*_callbacks.back());
+      _listeners.push_back(_callbacks.back().get());
+    }
+  }
+
+  // Starts the replay, the Leap delivers frames from open() on
+  void start() {
+    if (_replay) {
+      _replay->start();
+    }
+  }
+  void stop() {
+    if (_replay) {
+      _replay->stop();
+    }
+  }
+
+ private:
+  // Hands the Leap frames to a frame callback
+  class CallbackListener : public Leap::Listener {
+   public:
+    explicit CallbackListener(FrameCallback callback)
+        : _callback(std::move(callback)) {}
+    void onFrame(const Leap::Controller& controller) override {
+      _callback(RecordedFrame::from(controller.frame()));
+    }
+
+   private:
+    FrameCallback _callback;
+  };
+
+  const HandOptions _options;
+  std::unique_ptr<LeapController> _leap;
+  std::unique_ptr<HandReplay> _replay;
+  HandRecorder _recorder;
+  std::vector<Leap::Listener*> _listeners;
+  std::vector<std::unique_ptr<CallbackListener>> _callbacks;
+};
+}  // namespace RandomWalk::HandTracking
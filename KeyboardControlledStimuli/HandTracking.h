@@ -1,14 +1,26 @@
 #pragma once
 
 #include <Leap.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <list>
 #include <map>
+#include <memory>
+#include <optional>
 
 #include "ultraleap/haptics/library.hpp"
 #include "ultraleap/haptics/kit_transforms.hpp"
+#include "ultraleap/haptics/local_time.hpp"
+
+#include "HandFilter.hpp"
+#include "TripleBuffer.hpp"
 
 namespace RandomWalk::HandTracking {
 
+    // Bone centers of a hand as [finger][bone]
+    using BoneMatrix = Ultrahaptics::Vector3[5][4];
+
     // Structure to represent output from the Leap listener
     struct LeapOutput
     {
@@ -19,37 +31,133 @@ namespace RandomWalk::HandTracking {
         Ultrahaptics::Vector3 palm_direction;
         Ultrahaptics::Vector3 palm_normal;
         Ultrahaptics::Vector3 wrist_position;
-        //std::vector<Ultrahaptics::Vector3> finger_roots;
-        //std::vector<Ultrahaptics::Vector3> finger_tips;
-        Ultrahaptics::Vector3 finger_root_thumb;
-        Ultrahaptics::Vector3 finger_root_index;
-        Ultrahaptics::Vector3 finger_root_middle;
-        Ultrahaptics::Vector3 finger_root_ring;
-        Ultrahaptics::Vector3 finger_root_pinky;
-
-        Ultrahaptics::Vector3 finger_intermediate_thumb;
-        Ultrahaptics::Vector3 finger_intermediate_index;
-        Ultrahaptics::Vector3 finger_intermediate_middle;
-        Ultrahaptics::Vector3 finger_intermediate_ring;
-        Ultrahaptics::Vector3 finger_intermediate_pinky;
-
-        Ultrahaptics::Vector3 finger_proximal_thumb;
-        Ultrahaptics::Vector3 finger_proximal_index;
-        Ultrahaptics::Vector3 finger_proximal_middle;
-        Ultrahaptics::Vector3 finger_proximal_ring;
-        Ultrahaptics::Vector3 finger_proximal_pinky;
-
-        Ultrahaptics::Vector3 finger_tip_thumb;
-        Ultrahaptics::Vector3 finger_tip_index;
-        Ultrahaptics::Vector3 finger_tip_middle;
-        Ultrahaptics::Vector3 finger_tip_ring;
-        Ultrahaptics::Vector3 finger_tip_pinky;
+        // Bone centers by finger, thumb to pinky, and bone, metacarpal (root) to
+        // distal (tip). Filled in Leap's finger and bone order.
+        BoneMatrix bones;
 
         //Leap::FingerList fingers;
         bool hand_present = false;
         bool hand_is_left = false;
     };
 
+    // Hand data of one Leap frame, stamped with the local time it was captured at
+    struct HandFrame
+    {
+        Ultraleap::Haptics::LocalTimePoint time;
+        LeapOutput output;
+    };
+
+    // Hand data at any time, interpolated between a few recent frames. Times after
+    // the latest frame are extrapolated from the last two frames for up to
+    // max_extrapolation, later times hold the hand there. Times before the oldest
+    // frame hold the oldest one. Frames without a hand, or with the other hand,
+    // are not blended, the nearer frame is used as is.
+    class HandMotion
+    {
+    public:
+        static constexpr size_t capacity = 4;
+        static constexpr Ultraleap::Haptics::LocalDuration max_extrapolation = std::chrono::milliseconds(20);
+
+        HandMotion() = default;
+        // A hand standing still
+        explicit HandMotion(const LeapOutput& output)
+        {
+            push({ Ultraleap::Haptics::LocalTimePoint(), output });
+        }
+
+        // Appends a frame later than the held ones, the oldest is dropped when full
+        void push(const HandFrame& frame)
+        {
+            if (_size == capacity) {
+                std::move(_frames + 1, _frames + capacity, _frames);
+                _size--;
+            }
+            _frames[_size++] = frame;
+        }
+        void clear() { _size = 0; }
+        size_t size() const { return _size; }
+        // False if the hand is the same at all times
+        bool moving() const { return _size > 1; }
+
+        LeapOutput at(Ultraleap::Haptics::LocalTimePoint time) const
+        {
+            Segment s = segment(time);
+            if (s.a == nullptr) {
+                return LeapOutput();
+            }
+            if (s.fraction == 0.f) {
+                return s.a->output;
+            }
+            const LeapOutput& a = s.a->output;
+            const LeapOutput& b = s.b->output;
+            LeapOutput output = a;
+            output.palm_position += (b.palm_position - a.palm_position) * s.fraction;
+            output.palm_direction += (b.palm_direction - a.palm_direction) * s.fraction;
+            output.palm_normal += (b.palm_normal - a.palm_normal) * s.fraction;
+            output.wrist_position += (b.wrist_position - a.wrist_position) * s.fraction;
+            output.palm_direction = output.palm_direction.normalize();
+            output.palm_normal = output.palm_normal.normalize();
+            for (int finger = 0; finger < 5; finger++) {
+                for (int bone = 0; bone < 4; bone++) {
+                    output.bones[finger][bone] += (b.bones[finger][bone] - a.bones[finger][bone]) * s.fraction;
+                }
+            }
+            return output;
+        }
+        // Palm position of at(time), without blending the rest of the hand. Empty
+        // if there is no hand at that time, e.g. when it was lost after the start
+        // of a block.
+        std::optional<Ultrahaptics::Vector3> palm_at(Ultraleap::Haptics::LocalTimePoint time) const
+        {
+            Segment s = segment(time);
+            if (s.a == nullptr || !s.a->output.hand_present) {
+                return std::nullopt;
+            }
+            const Ultrahaptics::Vector3& palm = s.a->output.palm_position;
+            return palm + (s.b->output.palm_position - palm) * s.fraction;
+        }
+
+    private:
+        // Oldest first
+        HandFrame _frames[capacity];
+        size_t _size = 0;
+
+        // The hand at a time is a + (b - a) * fraction, fraction > 1 extrapolates
+        struct Segment
+        {
+            const HandFrame* a = nullptr;
+            const HandFrame* b = nullptr;
+            float fraction = 0.f;
+        };
+        Segment segment(Ultraleap::Haptics::LocalTimePoint time) const
+        {
+            if (_size == 0) {
+                return {};
+            }
+            const HandFrame* first = &_frames[0];
+            const HandFrame* last = &_frames[_size - 1];
+            if (_size == 1 || time <= first->time) {
+                return { first, first, 0.f };
+            }
+            size_t i = 1;
+            while (i < _size - 1 && _frames[i].time <= time) {
+                i++;
+            }
+            const HandFrame* a = &_frames[i - 1];
+            const HandFrame* b = &_frames[i];
+            time = std::min(time, last->time + max_extrapolation);
+            const LeapOutput& oa = a->output;
+            const LeapOutput& ob = b->output;
+            bool blend = oa.hand_present && ob.hand_present && oa.hand_is_left == ob.hand_is_left;
+            if (b->time <= a->time || !blend) {
+                const HandFrame* nearer = time - a->time < b->time - time ? a : b;
+                return { nearer, nearer, 0.f };
+            }
+            float fraction = (float)(time - a->time).count() / (b->time - a->time).count();
+            return { a, b, fraction };
+        }
+    };
+
     // Leap listener class - tracking the hand position and creating data structure for use by Ultraleap Haptics API
     class LeapListening : public Leap::Listener
     {
@@ -66,7 +174,9 @@ namespace RandomWalk::HandTracking {
             Leap::Frame frame = controller.frame();
             Leap::HandList hands = frame.hands();
 
-            LeapOutput local_hand_data;
+            // Filled in place in the buffer published next, without heap allocations
+            LeapOutput& local_hand_data = hand_data.back();
+            local_hand_data = LeapOutput();
 
             if (hands.isEmpty()) {
                 local_hand_data.palm_position = Ultraleap::Haptics::Vector3();
@@ -82,37 +192,19 @@ namespace RandomWalk::HandTracking {
                 Leap::Vector leap_palm_normal = hand.palmNormal();
                 Leap::Vector leap_wrist_position = hand.wristPosition();
 
-                // hand.fingers()
-                std::vector<Ultrahaptics::Vector3> finger_roots;
-                finger_roots.reserve(5);
-                for (auto& finger : hand.fingers())
-                {
-                    auto finger_root = finger.bone(Leap::Bone::Type::TYPE_METACARPAL).center();
-                    finger_roots.emplace_back(finger_root.x, finger_root.y, finger_root.z);
-                }
-
-                std::vector<Ultrahaptics::Vector3> finger_intermediates;
-                finger_intermediates.reserve(5);
-                for (auto& finger : hand.fingers())
-                {
-                    auto finger_intermediate = finger.bone(Leap::Bone::Type::TYPE_INTERMEDIATE).center();
-                    finger_intermediates.emplace_back(finger_intermediate.x, finger_intermediate.y, finger_intermediate.z);
-                }
-
-                std::vector<Ultrahaptics::Vector3> finger_proximals;
-                finger_proximals.reserve(5);
-                for (auto& finger : hand.fingers())
-                {
-                    auto finger_proximal = finger.bone(Leap::Bone::Type::TYPE_PROXIMAL).center();
-                    finger_proximals.emplace_back(finger_proximal.x, finger_proximal.y, finger_proximal.z);
-                }
-
-                std::vector<Ultrahaptics::Vector3> finger_tips;
-                finger_tips.reserve(5);
-                for (auto& finger : hand.fingers())
+                // Bone centers of all fingers in a single pass, Leap lists the fingers
+                // from thumb to pinky and its bone types from metacarpal to distal
+                int finger_index = 0;
+                for (const Leap::Finger& finger : hand.fingers())
                 {
-                    auto finger_tip = finger.bone(Leap::Bone::Type::TYPE_DISTAL).center();
-                    finger_tips.emplace_back(finger_tip.x, finger_tip.y, finger_tip.z);
+                    if (finger_index == 5) {
+                        break;
+                    }
+                    for (int bone_index = 0; bone_index < 4; bone_index++) {
+                        Leap::Vector center = finger.bone((Leap::Bone::Type)bone_index).center();
+                        local_hand_data.bones[finger_index][bone_index] = Ultrahaptics::Vector3(center.x, center.y, center.z);
+                    }
+                    finger_index++;
                 }
 
                 // Convert to Ultraleap Haptics vectors, normal is negated as leap normal points down.
@@ -127,46 +219,101 @@ namespace RandomWalk::HandTracking {
                 local_hand_data.palm_normal = ulh_palm_normal;
                 local_hand_data.wrist_position = ulh_wrist_position;
 
-                local_hand_data.finger_root_thumb = finger_roots[0];
-                local_hand_data.finger_root_index = finger_roots[1];
-                local_hand_data.finger_root_middle = finger_roots[2];
-                local_hand_data.finger_root_ring = finger_roots[3];
-                local_hand_data.finger_root_pinky = finger_roots[4];
-
-                local_hand_data.finger_intermediate_thumb = finger_intermediates[0];
-                local_hand_data.finger_intermediate_index = finger_intermediates[1];
-                local_hand_data.finger_intermediate_middle = finger_intermediates[2];
-                local_hand_data.finger_intermediate_ring = finger_intermediates[3];
-                local_hand_data.finger_intermediate_pinky = finger_intermediates[4];
-
-                local_hand_data.finger_proximal_thumb = finger_proximals[0];
-                local_hand_data.finger_proximal_index = finger_proximals[1];
-                local_hand_data.finger_proximal_middle = finger_proximals[2];
-                local_hand_data.finger_proximal_ring = finger_proximals[3];
-                local_hand_data.finger_proximal_pinky = finger_proximals[4];
-
-                local_hand_data.finger_tip_thumb = finger_tips[0];
-                local_hand_data.finger_tip_index = finger_tips[1];
-                local_hand_data.finger_tip_middle = finger_tips[2];
-                local_hand_data.finger_tip_ring = finger_tips[3];
-                local_hand_data.finger_tip_pinky = finger_tips[4];
-
-                //local_hand_data.finger_tips = finger_tips;
                 //local_hand_data.fingers = hand.fingers();
                 local_hand_data.hand_present = true;
                 local_hand_data.hand_is_left = hand.isLeft();
             }
 
-            atomic_local_hand_data.store(local_hand_data);
+            // Stamp the frame with the local time it was captured at, the age of
+            // the frame is measured on the Leap clock
+            std::chrono::microseconds age(controller.now() - frame.timestamp());
+            Ultraleap::Haptics::LocalTimePoint time = Ultraleap::Haptics::LocalTimeClock::now() - age;
+            recent_frames.push({ filter_hand(time, local_hand_data), local_hand_data });
+
+            hand_data.publish();
+            hand_motion.publish(recent_frames);
+            frame_count.fetch_add(1, std::memory_order_release);
         }
 
-        LeapOutput getLeapOutput()
+        // Publishes a frame that did not come from the Leap, e.g. a synthetic hand
+        // driving a mock emitter. Only from one thread, and never together with
+        // onFrame().
+        void push(const HandFrame& frame)
         {
-            return atomic_local_hand_data.load();
+            LeapOutput& local_hand_data = hand_data.back();
+            local_hand_data = frame.output;
+            recent_frames.push({ filter_hand(frame.time, local_hand_data), local_hand_data });
+            hand_data.publish();
+            hand_motion.publish(recent_frames);
+            frame_count.fetch_add(1, std::memory_order_release);
+        }
+
+        // Filters the hand of every frame before it is published, and predicts it
+        // the latency of the filter ahead. The frames are stamped that much later
+        // for the HandMotion, which only extrapolates past the predicted time, so
+        // the latency is not made up for twice. nullptr publishes the raw hand.
+        // Only while no frames arrive, i.e. before the listener is added.
+        void set_filter(std::unique_ptr<HandFilter> filter)
+        {
+            hand_filter = std::move(filter);
+        }
+
+        // The latest hand data. Wait-free, but only one thread at a time may read,
+        // usually the emitter callback. Valid until the next call.
+        const LeapOutput& getLeapOutput()
+        {
+            return hand_data.read();
+        }
+
+        // The recent frames, for sampling the hand at the time of each sample.
+        // Wait-free, but only one thread at a time may read. Valid until the next
+        // call.
+        const HandMotion& getHandMotion()
+        {
+            return hand_motion.read();
+        }
+
+        // Number of frames published so far. From any thread.
+        uint64_t frames() const
+        {
+            return frame_count.load(std::memory_order_acquire);
         }
 
     private:
-        std::atomic<LeapOutput> atomic_local_hand_data;
+        TripleBuffer<LeapOutput> hand_data;
+        TripleBuffer<HandMotion> hand_motion;
+        // Owned by the Leap thread
+        HandMotion recent_frames;
+        std::unique_ptr<HandFilter> hand_filter;
+        std::atomic<uint64_t> frame_count{0};
+
+        // Filters output in place, returns the time it stands for. Every frame is
+        // moved by the same latency, also those without a hand, to keep them in
+        // order.
+        Ultraleap::Haptics::LocalTimePoint filter_hand(const Ultraleap::Haptics::LocalTimePoint& time, LeapOutput& output)
+        {
+            if (!hand_filter) {
+                return time;
+            }
+            const Ultraleap::Haptics::LocalTimePoint predicted = time +
+                std::chrono::duration_cast<Ultraleap::Haptics::LocalDuration>(
+                    std::chrono::duration<double>(hand_filter->latency()));
+            // Palm, direction, normal, wrist and the bone centers
+            Ultrahaptics::Vector3 points[24] = {
+                output.palm_position, output.palm_direction, output.palm_normal, output.wrist_position
+            };
+            std::copy(&output.bones[0][0], &output.bones[0][0] + 20, points + 4);
+            double seconds = Ultraleap::Haptics::duration_to_sec(time.time_since_epoch());
+            if (!hand_filter->filter(seconds, output.hand_present, output.hand_is_left, points, 24)) {
+                return predicted;
+            }
+            output.palm_position = points[0];
+            output.palm_direction = points[1].normalize();
+            output.palm_normal = points[2].normalize();
+            output.wrist_position = points[3];
+            std::copy(points + 4, points + 24, &output.bones[0][0]);
+            return predicted;
+        }
     };
 
     class LeapController: public Leap::Controller {
@@ -177,5 +324,6 @@ namespace RandomWalk::HandTracking {
         }
     };
 
-    std::vector<std::vector<Ultrahaptics::Vector3>> translate_finger_output(LeapOutput* output);
+    // The bone centers of the hand as [finger][bone], see FingerIdx and BoneIdx
+    const BoneMatrix& translate_finger_output(const LeapOutput* output);
 }
\ No newline at end of file
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include <ultraleap/haptics/streaming.hpp>
+
+#include "json.hpp"
+
+namespace RandomWalk::Instrumentation {
+using namespace Ultraleap::Haptics;
+
+// Lock-free histogram of non-negative integer values, one bucket per power of
+// two. Bucket b counts the values in [2^b, 2^(b+1)), bucket 0 also counts 0
+// and the last bucket everything above. Recording is a few relaxed atomic
+// operations, so the emitter callback can record while another thread reads.
+// Readings taken during recording may be off by the values in flight.
+class Histogram {
+ public:
+  static constexpr size_t buckets = 40;
+
+  void record(int64_t value) {
+    uint64_t v = value > 0 ? (uint64_t)value : 0;
+    size_t bucket = 0;
+    for (uint64_t rest = v >> 1; rest > 0 && bucket + 1 < buckets; rest >>= 1) {
+      bucket++;
+    }
+    _counts[bucket].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(v, std::memory_order_relaxed);
+    uint64_t max = _max.load(std::memory_order_relaxed);
+    while (v > max &&
+           !_max.compare_exchange_weak(max, v, std::memory_order_relaxed)) {
+    }
+  }
+  void reset() {
+    for (auto& count : _counts) {
+      count.store(0, std::memory_order_relaxed);
+    }
+    _count.store(0, std::memory_order_relaxed);
+    _sum.store(0, std::memory_order_relaxed);
+    _max.store(0, std::memory_order_relaxed);
+  }
+
+  uint64_t count() const { return _count.load(std::memory_order_relaxed); }
+  double mean() const {
+    uint64_t n = count();
+    return n > 0 ? (double)_sum.load(std::memory_order_relaxed) / n : 0.0;
+  }
+  uint64_t max() const { return _max.load(std::memory_order_relaxed); }
+  // Upper bound of the bucket holding the p-th percentile, capped at max()
+  uint64_t percentile(double p) const {
+    uint64_t n = count();
+    if (n == 0) {
+      return 0;
+    }
+    uint64_t rank = std::max<uint64_t>(1, (uint64_t)(p / 100 * n + 0.5));
+    uint64_t seen = 0;
+    for (size_t b = 0; b < buckets; b++) {
+      seen += _counts[b].load(std::memory_order_relaxed);
+      if (seen >= rank) {
+        return std::min<uint64_t>((uint64_t(2) << b) - 1, max());
+      }
+    }
+    return max();
+  }
+
+  // Summary and the non-empty buckets keyed by their lower bound
+  nlohmann::json to_json() const {
+    nlohmann::json buckets_json = nlohmann::json::object();
+    for (size_t b = 0; b < buckets; b++) {
+      uint64_t n = _counts[b].load(std::memory_order_relaxed);
+      if (n > 0) {
+        buckets_json[std::to_string(b == 0 ? 0 : uint64_t(1) << b)] = n;
+      }
+    }
+    return {{"count", count()},           {"mean", mean()},
+            {"p50", percentile(50)},      {"p90", percentile(90)},
+            {"p99", percentile(99)},      {"max", max()},
+            {"buckets", buckets_json}};
+  }
+
+ private:
+  std::atomic<uint64_t> _counts[buckets] = {};
+  std::atomic<uint64_t> _count{0};
+  std::atomic<uint64_t> _sum{0};
+  std::atomic<uint64_t> _max{0};
+};
+
+// Per interval measurements of an emission callback. Durations are in ns.
+struct CallbackStats {
+  // Wall time spent in the callback
+  Histogram wall;
+  // Time left to the submission deadline when the callback returned
+  Histogram slack;
+  // Time past the submission deadline of the intervals that missed it
+  Histogram late;
+  // Samples per interval
+  Histogram samples;
+
+  void record(int64_t wall_ns, int64_t slack_ns, size_t n) {
+    wall.record(wall_ns);
+    if (slack_ns >= 0) {
+      slack.record(slack_ns);
+    } else {
+      late.record(-slack_ns);
+    }
+    samples.record((int64_t)n);
+  }
+  void reset() {
+    wall.reset();
+    slack.reset();
+    late.reset();
+    samples.reset();
+  }
+
+  nlohmann::json to_json() const {
+    return {{"intervals", wall.count()},
+            {"missed", late.count()},
+            {"wall_ns", wall.to_json()},
+            {"slack_ns", slack.to_json()},
+            {"late_ns", late.to_json()},
+            {"samples", samples.to_json()}};
+  }
+  // Without deadlines, e.g. for an emitter not running at real time, the
+  // slack and the missed deadlines are left out
+  void print(std::ostream& out, bool deadlines = true) const {
+    out << "Intervals: " << wall.count();
+    if (deadlines) {
+      out << ", missed deadlines: " << late.count();
+    }
+    out << std::endl;
+    auto line = [&out](const char* name, const Histogram& h) {
+      out << name << " mean " << h.mean() << " p50 " << h.percentile(50)
+          << " p90 " << h.percentile(90) << " p99 " << h.percentile(99)
+          << " max " << h.max() << std::endl;
+    };
+    line("wall ns: ", wall);
+    if (deadlines) {
+      line("slack ns:", slack);
+      line("late ns: ", late);
+    }
+    line("samples: ", samples);
+  }
+};
+
+// Emission callback for an emitter and its interval type, EmissionCallback for
+// the StreamingEmitter
+template <typename Emitter, typename Interval>
+using Callback = void (*)(const Emitter& emitter,
+                          Interval& interval,
+                          const LocalTimePoint& submission_deadline,
+                          void* user_pointer);
+
+// Wraps an emission callback and records the wall time, the slack to the
+// submission deadline and the sample count of every interval into stats. Set
+// emitter_callback with the InstrumentedCallback as user pointer instead of
+// the wrapped callback.
+class InstrumentedCallback {
+ public:
+  InstrumentedCallback() = default;
+  template <typename Emitter = StreamingEmitter,
+            typename Interval = OutputInterval>
+  InstrumentedCallback(Callback<Emitter, Interval> callback,
+                       void* user_pointer) {
+    wrap<Emitter, Interval>(callback, user_pointer);
+  }
+  InstrumentedCallback(const InstrumentedCallback&) = delete;
+  InstrumentedCallback& operator=(const InstrumentedCallback&) = delete;
+
+  // Only while the emission callback is not running. Emitter and Interval
+  // have to match the emitter_callback instantiation that is set.
+  template <typename Emitter = StreamingEmitter,
+            typename Interval = OutputInterval>
+  void wrap(Callback<Emitter, Interval> callback, void* user_pointer) {
+    _callback = reinterpret_cast<void (*)()>(callback);
+    _user_pointer = user_pointer;
+  }
+
+  CallbackStats stats;
+
+  template <typename Emitter = StreamingEmitter,
+            typename Interval = OutputInterval>
+  static void emitter_callback(const Emitter& emitter,
+                               Interval& interval,
+                               const LocalTimePoint& submission_deadline,
+                               void* user_pointer) {
+    InstrumentedCallback* self =
+        static_cast<InstrumentedCallback*>(user_pointer);
+    LocalTimePoint start = LocalTimeClock::now();
+    if (self->_callback != nullptr) {
+      reinterpret_cast<Callback<Emitter, Interval>>(self->_callback)(
+          emitter, interval, submission_deadline, self->_user_pointer);
+    }
+    LocalTimePoint end = LocalTimeClock::now();
+
+    const LocalDuration& period = interval.iteratorTimeInterval();
+    int64_t span = (interval.intervalEnd() - interval.firstSample()).count();
+    size_t n = period.count() > 0
+                   ? (size_t)((span + period.count() - 1) / period.count())
+                   : 0;
+    self->stats.record((end - start).count(),
+                       (submission_deadline - end).count(), n);
+  }
+
+ private:
+  // The wrapped Callback<Emitter, Interval>
+  void (*_callback)() = nullptr;
+  void* _user_pointer = nullptr;
+};
+}  // namespace RandomWalk::Instrumentation
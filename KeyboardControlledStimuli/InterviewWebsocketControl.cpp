@@ -1,5 +1,6 @@
 
 #include <conio.h>
+#include <atomic>
 #include <chrono>
 #include <cmath>
 #include <cstdlib>
@@ -7,6 +8,10 @@
 #include <future>
 #include <iostream>
 #include <map>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <random>
 #include <string>
 #include <thread>
 
@@ -22,9 +27,14 @@
 #include "ultraleap/haptics/sensations.hpp"
 #include "ultraleap/haptics/streaming.hpp"
 
+#include "HandStream.hpp"
 #include "LeapHandConverter.hpp"
+#include "SensationPool.hpp"
+#include "SensationTrials.hpp"
+#include "TrialGate.hpp"
+#include "TrialPlan.hpp"
 
-#include "Timer.hpp"
+#include "Scheduler.hpp"
 #include "Utils.hpp"
 
 #ifndef M_PI
@@ -46,26 +56,7 @@ const std::string sensation_configuration = "SensationConfigs/Study2.json";
 using namespace Ultraleap::Haptics;
 static easywsclient::WebSocket::pointer ws = NULL;
 
-// #0 parameter name, #1 parameter value
-typedef std::map<std::string, float> parameters;
-// #0 sensation name, #1 sensation key, #2 parameters
-typedef std::tuple<std::string, std::string, parameters> sensation;
-// #0 sensation identifier, #1 sensation
-typedef std::map<std::string, sensation> sensations;
-typedef std::vector<float> sensation_value;
-// #0 sensation name, #1 sensation key
-typedef std::map<std::string, sensation_value> sensation_values;
-
-class FrameListener : public Leap::Listener {
- public:
-  FrameListener(
-      std::function<void(const Leap::Controller& controller)> callback)
-      : callback(callback) {}
-  void onFrame(const Leap::Controller& controller) override {
-    callback(controller);
-  }
-  std::function<void(const Leap::Controller& controller)> callback;
-};
+using namespace RandomWalk::Sensations;
 
 int getch_noblock() {
   if (_kbhit())
@@ -130,185 +121,80 @@ int entry(int argc, char* argv[]) {
 #pragma endregion
 
 #pragma region PARSE_SENSATION_CONFIG
-
-  sensations _sensations;
-
-  json jsensations;
-  try {
-    std::ifstream fj(sensation_configuration);
-    try {
-      fj >> jsensations;
-    } catch (const std::exception&) {
-      std::cerr << "Failed to parse sensations JSON" << std::endl;
+  // Optional arguments: --config with a sensation configuration or a trial
+  // plan compiled by OfflineRenderer in place of the default one, and a seed
+  // to replay the trial order of a session
+  std::string configuration = sensation_configuration;
+  std::optional<uint64_t> seed;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--config" && i + 1 < argc) {
+      configuration = argv[++i];
+    } else if (!(seed = Utils::parse_seed(arg))) {
+      std::cout << "Usage: " << argv[0] << " [--config <path>] [seed]"
+                << std::endl;
       return 1;
     }
-  } catch (const std::exception&) {
-    std::cerr << "Failed to load sensations JSON" << std::endl;
+  }
+  if (seed && !randomize) {
+    std::cout << "A seed needs randomize, the trials are played in order"
+              << std::endl;
     return 1;
   }
+  TrialPlan plan;
+  if (plan.open(configuration) > 0) {
+    return 1;
+  }
+  const SensationTrials& trials = plan.trials();
+#pragma endregion
 
-  std::string sensations_key = "sensations";
-  std::string shared_params_key = "shared_params";
-  std::string sensation_key = "sensation";
-  std::string sensation_name_key = "name";
-  std::string sensation_shared_params_key = "shared_params";
-  std::string sensation_params_key = "params";
-
-  std::map<std::tuple<std::string, std::string>, sensation_values> iterators;
-  if (jsensations.contains(sensations_key)) {
-    for (auto& jsensation : jsensations[sensations_key]) {
-      parameters parameters;
-
-      std::string sensation_id = jsensation[sensation_key];
-      Utils::replace(sensation_id, "\"", "");
-
-      std::string sensation_name = sensation_id;
-      if (jsensation.contains(sensation_name_key)) {
-        sensation_name = jsensation[sensation_name_key];
-        Utils::replace(sensation_name, "\"", "");
-      }
-
-      std::tuple<std::string, std::string> id = {sensation_name, sensation_id};
-
-      // insert shared parameters
-      if (jsensation.contains(sensation_shared_params_key)) {
-        auto curr_sensation_it = iterators.find(id);
-        sensation_values curr_sensation = {};
-        if (curr_sensation_it != iterators.end()) {
-          curr_sensation = curr_sensation_it->second;
-        }
-
-        auto o = jsensation[sensation_shared_params_key];
-        for (json::iterator it = o.begin(); it != o.end(); ++it) {
-          if (jsensations[shared_params_key].contains(it.key())) {
-            auto value = it.value().dump();
-            if (it.value().is_string()) {
-              Utils::replace(value, "\"", "");
-            } else {
-              continue;
-            }
-            auto curr_param_it = curr_sensation.find(value);
-            sensation_value curr_params;
-            if (curr_param_it != curr_sensation.end()) {
-              curr_params = curr_param_it->second;
-            }
-
-            auto values = jsensations[shared_params_key][it.key()];
-            curr_params.insert(curr_params.end(), values.begin(), values.end());
-            curr_sensation.insert({value, curr_params});
-          }
-        }
-        iterators[id] = curr_sensation;
-      }
-
-      if (jsensation.contains(sensation_params_key)) {
-        auto curr_sensation_it = iterators.find(id);
-        sensation_values curr_sensation;
-        if (curr_sensation_it != iterators.end()) {
-          curr_sensation = curr_sensation_it->second;
-        }
-
-        auto o = jsensation[sensation_params_key];
-        for (json::iterator it = o.begin(); it != o.end(); ++it) {
-          sensation_value curr_params;
-          auto curr_param_it = curr_sensation.find(it.key());
-          if (curr_param_it != curr_sensation.end()) {
-            curr_params = curr_param_it->second;
-          }
-
-          auto values = it.value();
-          if (!values.is_array()) {
-            values = std::vector<float>{values};
-          }
-
-          curr_params.insert(curr_params.end(), values.begin(), values.end());
-          curr_sensation.insert({it.key(), curr_params});
-        }
-        iterators[id] = curr_sensation;
-      }
-
-      if (!jsensation.contains(sensation_shared_params_key) &&
-          !jsensation.contains(sensation_params_key)) {
-        iterators[id] = {};
-      }
-    }
-
-    for (auto sensation : iterators) {
-      std::string sensation_name = std::get<0>(sensation.first);
-      std::string sensation_id = std::get<1>(sensation.first);
-
-      auto keys = Utils::map_get_keys(sensation.second);
-      auto values = Utils::map_get_values(sensation.second);
-
-      // number of arrays
-      int n = sensation.second.size();
-
-      // to keep track of next element in each of
-      // the n arrays
-      int* indices = new int[n];
-
-      // initialize with first element's index
-      for (int i = 0; i < n; i++)
-        indices[i] = 0;
-
-      while (1) {
-        std::string k = sensation_name + "_" + sensation_id;
-        parameters params;
-        for (int i = 0; i < n; i++) {
-          auto key = keys[i];
-          auto value = values[i][indices[i]];
-          std::stringstream stream;
-          stream << std::fixed << std::setprecision(3) << value;
-          std::string s = stream.str();
-          k = k + "_" + key.substr(0, 2) + s;
-          params.insert({key, value});
-        }
-        _sensations.insert({k, {sensation_name, sensation_id, params}});
-
-        // find the rightmost array that has more
-        // elements left after the current element
-        // in that array
-        int next = n - 1;
-        while (next >= 0 && (indices[next] + 1 >= values[next].size()))
-          next--;
-
-        // no such array is found so no more
-        // combinations left
-        if (next < 0)
-          break;
-
-        // if found move to next element in that
-        // array
-        indices[next]++;
+#pragma region SENSATION_POOL
+  // Played before the first trial
+  const sensation training_sensation = {
+      "training_sensation",
+      "RW.AmplitudeModulatedPoint",
+      {{"maxIntensity", 1}, {"frequency", 250}}};
 
-        // for all arrays to the right of this
-        // array current index again points to
-        // first element
-        for (int i = next + 1; i < n; i++)
-          indices[i] = 0;
-      }
-    }
+  // One instance per sensation, trials only patch their arguments
+  SensationPool pool;
+  if (pool.load(sensation_package, trials, {training_sensation}) > 0) {
+    return 1;
   }
 #pragma endregion
 
 #pragma region RANDOMIZATION
 
-  // Load the data of the named Sensation
-  auto sensation_keys = Utils::map_get_keys(_sensations);
+  // The trials in the order they are played, decoded when they are played
+  std::vector<size_t> trial_order(trials.size());
+  std::iota(trial_order.begin(), trial_order.end(), size_t(0));
 
-  auto shuffle_keys = [&]() {
+  // Without a seed one is drawn and printed, so any session can be replayed.
+  // Round r is played in the order of seed + r, read from the plan if it was
+  // compiled with that seed.
+  if (!seed) {
+    seed = std::random_device{}();
+  }
+  auto shuffle_trials = [&](uint64_t round) {
     if (randomize) {
-      std::shuffle(sensation_keys.begin(), sensation_keys.end(),
-                   std::default_random_engine(time(NULL)));
+      trial_order = plan.order(seed.value() + round);
     }
   };
-  shuffle_keys();
+  shuffle_trials(0);
+  if (randomize) {
+    std::cout << "Trial order seed: " << seed.value() << std::endl;
+  }
 #pragma endregion
 
   int current_repetition = 0;
   int idx = -1;
 
+  // Times the trials on one thread, the timers of the trial played are
+  // cancelled when the next sensation is set
+  Time::Scheduler scheduler;
+  Time::Scheduler::Handle trial_timers;
+
   auto setSensation = [&](std::string _sensation_id, sensation _sensation,
+                          SensationInstance& sensation_instance,
                           bool notify = false, bool play = true) {
     if (!emitter.isPaused().value()) {
       emitter.pause();
@@ -319,25 +205,9 @@ int entry(int argc, char* argv[]) {
     std::string sensation_id = std::get<1>(_sensation);
     parameters params = std::get<2>(_sensation);
 
-    const auto hand_tracked_sensation =
-        sensation_package.sensation(sensation_id);
-    if (!hand_tracked_sensation) {
-      throw "Unknown sensation";
-    }
-
     std::cout << "now playing: " << sensation_name << std::endl;
-
-    // Created an instance of the Sensation
-    auto sensation_instance = SensationInstance(hand_tracked_sensation.value());
-
-    auto p_keys = Utils::map_get_keys(params);
-    auto excluded_keys = {"duration", "meta_frequency"};
-    for (auto& parameter : p_keys) {
-      if (std::find(excluded_keys.begin(), excluded_keys.end(), parameter) ==
-          excluded_keys.end()) {
-        sensation_instance.set(parameter, params[parameter]);
-      }
-    }
+    trial_timers.cancel();
+    trial_timers = Time::Scheduler::Handle();
 
     // Set the instance on the emitter
     const auto set_result = emitter.setSensation(sensation_instance);
@@ -352,57 +222,65 @@ int entry(int argc, char* argv[]) {
 
     auto duration_it = params.find("duration");
     if (duration_it != params.end()) {
-      float duration = duration_it->second;
-
       auto meta_frequency_it = params.find("meta_frequency");
       if (meta_frequency_it != params.end() && play) {
-        float meta_frequency = meta_frequency_it->second;
-        int frac = (int)duration / meta_frequency;
+        const TrialGate gate = TrialGate::of(params);
 
         auto get_now = []() {
           return (std::chrono::system_clock::now().time_since_epoch() /
                   std::chrono::milliseconds(1));
         };
 
-        auto toggle_emitter = [&]() {
-          if (emitter.isPaused().value()) {
-            emitter.resume();
-          } else {
-            emitter.pause();
+        auto finished = [&, get_now]() {
+          emitter.clearSensation();
+          std::cout << "finished playing \t" << get_now() << std::endl
+                    << "-" << std::endl;
+          if (advance_with_websocket) {
+            ws->send("stmfinishedplaying");
           }
-        };
 
-        Time::Timer t = Time::Timer();
+          // check for end?
+          std::cout << "idx: " << idx
+                    << " senskeys:" << trials.size() << std::endl;
+          if (idx + 1 >= trials.size()) {
+            current_repetition += 1;
+            std::cout << "end reached ---------------------" << std::endl;
 
-        std::cout << "start playing \t\t" << get_now() << std::endl;
-        t.setInterval(toggle_emitter, frac);
-        t.setTimeout(
-            [&]() {
-              t.stop();
-              emitter.clearSensation();
-              std::cout << "finished playing \t" << get_now() << std::endl
-                        << "-" << std::endl;
+            if (current_repetition >= repetitions) {
+              std::cout << "no more repetitions -------------" << std::endl;
               if (advance_with_websocket) {
-                ws->send("stmfinishedplaying");
+                ws->send("stmend");
               }
+            }
+            // shuffle_trials(current_repetition);
+          }
+        };
 
-              // check for end?
-              std::cout << "idx: " << idx
-                        << " senskeys:" << sensation_keys.size() << std::endl;
-              if (idx + 1 >= sensation_keys.size()) {
-                current_repetition += 1;
-                std::cout << "end reached ---------------------" << std::endl;
-
-                if (current_repetition >= repetitions) {
-                  std::cout << "no more repetitions -------------" << std::endl;
-                  if (advance_with_websocket) {
-                    ws->send("stmend");
-                  }
-                }
-                // shuffle_keys();
-              }
-            },
-            duration);
+        std::cout << "start playing \t\t" << get_now() << std::endl;
+        if (gates_itself(sensation_instance)) {
+          // The sensation gates itself from the sample it was set at, the
+          // emitter plays on until the end
+          std::cout << gate.on_windows() << " on windows of " << gate.window()
+                    << " ms" << std::endl;
+          trial_timers = on_trial_end(scheduler, emitter, gate, finished);
+        } else {
+          // Gated by pausing the emitter, when the scheduler gets to it
+          auto toggle_emitter = [&]() {
+            if (emitter.isPaused().value()) {
+              emitter.resume();
+            } else {
+              emitter.pause();
+            }
+          };
+          trial_timers = scheduler.setInterval(
+              toggle_emitter, Time::Scheduler::from_ms(gate.window()));
+          scheduler.setTimeout(
+              [timers = trial_timers, finished]() mutable {
+                timers.cancel();
+                finished();
+              },
+              Time::Scheduler::from_ms(gate.duration), trial_timers);
+        }
       }
     }
 
@@ -417,8 +295,6 @@ int entry(int argc, char* argv[]) {
       }
       ws->send("stm" + jsensation.dump());
     }
-
-    return sensation_instance;
   };
 
   std::cout << "Running interview configuration." << std::endl;
@@ -428,40 +304,34 @@ int entry(int argc, char* argv[]) {
   }
 
   // Utils::print_element(sensation_keys);
-  std::cout << sensation_keys.size() << " combinations, " << repetitions
-            << " repetitions, " << sensation_keys.size() * repetitions
+  std::cout << trials.size() << " combinations, " << repetitions
+            << " repetitions, " << trials.size() * repetitions
             << " total trials" << std::endl;
 
   try {
-    sensation training_sensation = {"training_sensation",
-                                    "RW.AmplitudeModulatedPoint",
-                                    {{"maxIntensity", 1}, {"frequency", 250}}};
-    SensationInstance sensation_instance =
-        setSensation("", training_sensation, false, false);
+    // The instance played, the hand is set on it from the Leap thread. The
+    // mutex is held while it is patched for a trial or the hand is set, the
+    // pooled instances are not safe to change from two threads.
+    std::mutex instance_mutex;
+    SensationInstance* sensation_instance = &pool.apply(training_sensation);
+    setSensation("", training_sensation, *sensation_instance, false, false);
 #pragma region LEAP_SETUP
 
-    // Set up Leap
-    Leap::Controller leap_control;
-    leap_control.setPolicyFlags(
-        Leap::Controller::PolicyFlag::POLICY_BACKGROUND_FRAMES);
+    // Set up Leap, or the hand recording replayed in its place
+    HandTracking::HandStream hands;
+    if (hands.open() > 0) {
+      return 1;
+    }
 
     // Set up the Leap Frame callback
     LeapHandConverter hand_converter(tracking_transform);
-    auto on_frame_callback = [&](const Leap::Controller& controller) {
-      const Leap::HandList hands = leap_control.frame().hands();
-      if (!hands.isEmpty()) {
-        Leap::Hand hand = hands[0];
-        sensation_instance.set("hand",
-                               hand_converter.toElementSimpleHand(hand));
-      } else {
-        sensation_instance.set("hand",
-                               LeapHandConverter::invalidElementSimpleHand());
-      }
-      emitter.updateSensationArguments(sensation_instance);
-    };
-
-    FrameListener frame_listener = FrameListener(on_frame_callback);
-    leap_control.addListener(frame_listener);
+    hands.on_frame([&](const HandTracking::RecordedFrame& frame) {
+      std::lock_guard<std::mutex> lock(instance_mutex);
+      SensationInstance& instance = *sensation_instance;
+      instance.set("hand", hand_converter.toElementSimpleHand(frame));
+      emitter.updateSensationArguments(instance);
+    });
+    hands.start();
 #pragma endregion
 
     // Start the emitter
@@ -478,11 +348,22 @@ int entry(int argc, char* argv[]) {
 
       std::cout << "idx: " << idx << std::endl;
 
-      if (idx < sensation_keys.size()) {
-        std::cout << idx << "/" << sensation_keys.size() << std::endl;
-        std::string current_sensation = sensation_keys[idx];
-        sensation_instance = setSensation(
-            current_sensation, _sensations[current_sensation], advance);
+      if (idx < trials.size()) {
+        std::cout << idx << "/" << trials.size() << std::endl;
+        size_t trial = trial_order[idx];
+        auto switch_start = std::chrono::steady_clock::now();
+        {
+          std::lock_guard<std::mutex> lock(instance_mutex);
+          SensationInstance& instance = pool.apply(trial);
+          sensation_instance = &instance;
+          setSensation(trials.key(trial), trials.trial(trial), instance,
+                       advance);
+        }
+        std::cout << "switched in "
+                  << std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::steady_clock::now() - switch_start)
+                         .count()
+                  << " us" << std::endl;
       }
     };
 
@@ -500,7 +381,7 @@ int entry(int argc, char* argv[]) {
           }
         });
 
-        if (idx >= static_cast<int>(sensation_keys.size())) {
+        if (idx >= static_cast<int>(trials.size())) {
           break;
         }
 
@@ -512,7 +393,7 @@ int entry(int argc, char* argv[]) {
       }
     } else {
       while (true) {
-        if (idx >= static_cast<int>(sensation_keys.size())) {
+        if (idx >= static_cast<int>(trials.size())) {
           break;
         }
 
@@ -13,6 +13,7 @@
 
 #include "HandTracking.h"
 #include "Entries.h"
+#include "Runtime.h"
 
 using namespace Ultraleap::Haptics;
 
@@ -77,65 +78,25 @@ namespace RandomWalk::KeyboardControlledPoint
 
     int entry(int argc, char *argv[])
     {
-
-        // Create a Library object and connect it to a running service
-        Library lib;
-        auto found_library = lib.connect();
-        if (!found_library)
-        {
-            std::cout << "Library failed to connect: " << found_library.error().message() << std::endl;
-            return 1;
-        }
-
-        // Create a streaming emitter and add a suitable device to it
-        StreamingEmitter emitter{lib};
-        auto device = lib.findDevice(DeviceFeatures::StreamingHaptics);
-        if (!device)
-        {
-            std::cout << "Failed to find device: " << device.error().message() << std::endl;
-            return 1;
-        }
-
-        // If we found a device, get the default transform from Leap to Haptics device space
-        auto transform = device.value().getKitTransform();
-        if (!transform)
-        {
-            std::cerr << "Unknown device transform: " << transform.error().message() << std::endl;
-            return 1;
-        }
-
-        auto add_res = emitter.addDevice(device.value(), transform.value());
-        if (!add_res)
-        {
-            std::cout << "Failed to add device: " << add_res.error().message() << std::endl;
-            return 1;
-        }
-
-        HandTracking::LeapController leap_control;
-
         // Create a structure containing our control point data and fill it in from the file.
         ModulatedPoint point;
 
-        leap_control.addListener(point.hand);
-
-        // Get the achievable sample_rate for the number of control points we are producing
-        auto cp_res = emitter.setControlPointCount(1, AdjustRate::All);
-        if (!cp_res)
+        // Declared after the point, so the emitter is stopped before it is destroyed
+        Streaming::Runtime runtime;
+        if (runtime.init() > 0)
         {
-            std::cout << "Failed to setControlPointCount: " << cp_res.error().message() << std::endl;
             return 1;
         }
+        runtime.listen(point.hand);
 
         // Set the callback function to the callback written above
-        auto ec_res = emitter.setEmissionCallback(my_emitter_callback, &point);
-        if (!ec_res)
+        if (runtime.set_callback(my_emitter_callback, &point) > 0)
         {
-            std::cout << "Failed to setEmissionCallback: " << ec_res.error().message() << std::endl;
             return 1;
         }
 
         // Start the array
-        emitter.start();
+        runtime.start();
 
         // Wait for enter key to be pressed.
         std::cout << "Hit ENTER to quit..." << std::endl;
@@ -197,7 +158,7 @@ namespace RandomWalk::KeyboardControlledPoint
         }
 
         // Stop the array
-        emitter.stop();
+        runtime.stop();
 
         return 0;
     }
@@ -1,21 +1,65 @@
 ﻿#include <conio.h>
+#include <cstring>
+#include <iostream>
 
 #include "Entries.h"
+#include "HandStream.hpp"
 
-int main(int argc, char* argv[]) {
-  // return RandomWalk::KeyboardControlledSensationLibrary::entry(argc, argv);
-
-  // return RandomWalk::KeyboardControlledPoint::entry(argc, argv);
-
-  // return RandomWalk::LeapTrackingParameterSpace::entry(argc, argv);
+namespace {
+struct Mode {
+  const char* name;
+  int (*entry)(int argc, char* argv[]);
+  const char* description;
+};
 
-  // return RandomWalk::MariannasParameterSpace::entry(argc, argv);
+// The entry started without a mode comes first
+const Mode modes[] = {
+    {"interview-ws", RandomWalk::Interview::Websockets::entry,
+     "interview sensations controlled over a websocket"},
+    {"sensation-library", RandomWalk::KeyboardControlledSensationLibrary::entry,
+     "sensation library controlled by keyboard"},
+    {"point", RandomWalk::KeyboardControlledPoint::entry,
+     "modulated point controlled by keyboard"},
+    {"leap-tracking", RandomWalk::LeapTrackingParameterSpace::entry,
+     "point on a tracked hand position"},
+    {"marianna", RandomWalk::MariannasParameterSpace::entry,
+     "Marianna's parameter space"},
+    {"random", RandomWalk::Parameters::entry,
+     "random configurations controlled by keyboard"},
+    {"composite", RandomWalk::Parameters::Composite::entry,
+     "several configurations on one stream"},
+    {"random-ws", RandomWalk::Parameters::Websockets::entry,
+     "random configurations controlled over a websocket"},
+    {"sensations-ws", RandomWalk::Sensations::Websockets::entry,
+     "sensations controlled over a websocket"},
+};
 
-  // return RandomWalk::Parameters::entry(argc, argv);
+void print_usage(const char* program) {
+  std::cout << "Usage: " << program
+            << " [hand options] [mode] [mode arguments...]" << std::endl
+            << "Modes:" << std::endl;
+  for (const Mode& mode : modes) {
+    std::cout << "  " << mode.name << "\t" << mode.description << std::endl;
+  }
+  RandomWalk::HandTracking::print_hand_options_usage(std::cout);
+}
+}  // namespace
 
-  // return RandomWalk::Parameters::Websockets::entry(argc, argv);
-
-  // return RandomWalk::Sensations::Websockets::entry(argc, argv);
-
-  return RandomWalk::Interview::Websockets::entry(argc, argv);
+// The hand options come first, then the mode. The arguments after the mode
+// are handed to its entry, which sees the mode name as its program name.
+int main(int argc, char* argv[]) {
+  if (RandomWalk::HandTracking::take_hand_options(argc, argv) > 0) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  if (argc < 2) {
+    return modes[0].entry(argc, argv);
+  }
+  for (const Mode& mode : modes) {
+    if (std::strcmp(argv[1], mode.name) == 0) {
+      return mode.entry(argc - 1, argv + 1);
+    }
+  }
+  print_usage(argv[0]);
+  return std::strcmp(argv[1], "--help") == 0 ? 0 : 1;
 }
\ No newline at end of file
@@ -10,6 +10,8 @@
 #include <vector>
 #include "ultraleap/haptics/streaming.hpp"
 
+#include "HandRecording.hpp"
+
 using namespace Ultraleap::Haptics;
 
 class LeapHandConverter {
@@ -46,6 +48,34 @@ class LeapHandConverter {
     return element_hand;
   }
 
+  // The same for a recorded or replayed frame
+  std::vector<float> toElementSimpleHand(
+      const RandomWalk::HandTracking::RecordedFrame& frame) const {
+    using RandomWalk::HandTracking::RecordedFrame;
+    if (!frame.hand_present) {
+      return invalidElementSimpleHand();
+    }
+    std::vector<float> element_hand;
+    element_hand.reserve(86);
+    element_hand.push_back(1.f);
+    element_hand.push_back(frame.hand_is_left ? 0.f : 1.f);
+
+    appendToVector(element_hand, RecordedFrame::vector(frame.palm_position),
+                   true);
+    appendToVector(element_hand, RecordedFrame::vector(frame.palm_direction),
+                   false);
+    appendToVector(element_hand, RecordedFrame::vector(frame.palm_normal),
+                   false);
+
+    for (const auto& finger : frame.joints) {
+      for (const auto& joint : finger) {
+        appendToVector(element_hand, RecordedFrame::vector(joint), true);
+      }
+    }
+
+    return element_hand;
+  }
+
  private:
   // Append the Leap::Vector to the std::vector<float>
   //
@@ -55,8 +85,12 @@ class LeapHandConverter {
   void appendToVector(std::vector<float>& current_vector,
                       const Leap::Vector& v,
                       bool is_position) const {
-    const Vector3 original_vector(v.x, v.y, v.z);
+    appendToVector(current_vector, Vector3(v.x, v.y, v.z), is_position);
+  }
 
+  void appendToVector(std::vector<float>& current_vector,
+                      const Vector3& original_vector,
+                      bool is_position) const {
     Vector3 transformed_vector;
     if (is_position) {
       transformed_vector = _transform.transformPosition(original_vector);
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <thread>
+
+#include <ultraleap/haptics/streaming.hpp>
+
+#include "ConfigurationSlot.h"
+#include "Engine.h"
+#include "TripleBuffer.hpp"
+
+namespace RandomWalk::Parameters::Engine {
+using namespace Ultraleap::Haptics;
+
+// Renders the samples of a ConfigurationSlot ahead of the emitter on a
+// producer thread, so the emission callback only copies precomputed samples
+// into the interval and its duration does not depend on the configuration.
+//
+// The samples are kept in a single-producer/single-consumer ring keyed by
+// sample index. The producer stays up to lead samples ahead of the last
+// interval the callback consumed. If an interval is not in the ring, e.g.
+// right after starting or when the producer was descheduled, the callback
+// renders it directly and the producer continues after it. The slot is only
+// rendered by one thread at a time, guarded by a flag the producer holds for
+// one block. The callback does not wait for it: if the producer is rendering,
+// the callback renders on a copy of the configuration instead, taken by the
+// producer whenever the slot switches, with the hand the producer read last.
+//
+// The hand data is read when a block is rendered, so with look-ahead the
+// stimulus follows the hand up to lead samples later.
+class LookAhead {
+ public:
+  // lead and block in samples, lead is rounded up to whole blocks
+  LookAhead(ConfigurationSlot& slot, size_t lead = 512, size_t block = 32)
+      : _slot(slot),
+        _block(block),
+        _lead(((lead + block - 1) / block) * block) {
+    size_t capacity = 1;
+    while (capacity < 2 * _lead) {
+      capacity <<= 1;
+    }
+    _mask = capacity - 1;
+    _ring = std::make_unique<Slot[]>(capacity);
+  }
+  ~LookAhead() { stop(); }
+  LookAhead(const LookAhead&) = delete;
+  LookAhead& operator=(const LookAhead&) = delete;
+
+  // Starts the producer, it begins rendering once the first interval tells
+  // the sample index and rate of the emitter. Set the first configuration on
+  // the slot before, and start the emitter after.
+  void start() {
+    if (_running.exchange(true)) {
+      return;
+    }
+    lock();
+    update_copy();
+    unlock();
+    _producer = std::thread(&LookAhead::produce, this);
+  }
+  // Stops the producer. Stop the emitter first.
+  void stop() {
+    if (!_running.exchange(false)) {
+      return;
+    }
+    _producer.join();
+  }
+
+  // Intervals taken from the ring, and intervals rendered in the callback
+  uint64_t hits() const { return _hits.load(std::memory_order_relaxed); }
+  uint64_t misses() const { return _misses.load(std::memory_order_relaxed); }
+
+  // Emission callback, user_pointer is the LookAhead
+  template <typename Emitter = StreamingEmitter,
+            typename Interval = OutputInterval>
+  static void emitter_callback(const Emitter& emitter,
+                               Interval& interval,
+                               const LocalTimePoint& submission_deadline,
+                               void* user_pointer) {
+    LookAhead* self = static_cast<LookAhead*>(user_pointer);
+
+    const LocalDuration& period = interval.iteratorTimeInterval();
+    size_t n = 0;
+    for (auto it = interval.begin(); it != interval.end(); ++it) {
+      n++;
+    }
+    const int64_t first = sample_clock.index(interval.firstSample(), period);
+    const double rate = Time::SampleClock::rate(period);
+    RenderedSamples& out = self->_out;
+
+    if (self->consume(first, rate, n, out)) {
+      self->_hits.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      // Render directly, the producer continues after this interval
+      if (self->try_lock()) {
+        self->_slot.render(first, rate, n, out);
+        self->unlock();
+      } else if (Copy* copy = self->_lent.exchange(nullptr,
+                                                   std::memory_order_acquire)) {
+        bool hand = copy->render(copy->config.get(), self->_motion.read(),
+                                 first, rate, n);
+        out.copy(copy->config->block, 0, hand);
+        self->_lent.store(copy, std::memory_order_release);
+      }
+      self->_rate.store(rate, std::memory_order_relaxed);
+      self->_request.store(first + (int64_t)n, std::memory_order_release);
+      self->_misses.fetch_add(1, std::memory_order_relaxed);
+    }
+    self->_read.store(first + (int64_t)n, std::memory_order_release);
+    out.write(interval);
+  }
+
+ private:
+  static constexpr int64_t none = std::numeric_limits<int64_t>::min();
+
+  // One sample of the ring. index is written last by the producer and read
+  // before and after the data by the callback, a sample whose index changed
+  // in between is discarded like a missing one. The data is atomic as well,
+  // accessed relaxed and ordered by the fences around it.
+  struct Slot {
+    std::atomic<int64_t> index{none};
+    std::atomic<float> x{0.f}, y{0.f}, z{0.f}, intensity{0.f};
+    std::atomic<bool> hand{false};
+  };
+
+  // A configuration of the slot and its evaluation state, copied
+  struct Copy {
+    std::unique_ptr<Configuration> config;
+    RenderFunction render = nullptr;
+  };
+
+  ConfigurationSlot& _slot;
+  const size_t _block;
+  const size_t _lead;
+  size_t _mask;
+  std::unique_ptr<Slot[]> _ring;
+
+  std::thread _producer;
+  std::atomic<bool> _running{false};
+  std::atomic_flag _rendering = ATOMIC_FLAG_INIT;
+  // Written by the callback: the end of the last consumed interval, a sample
+  // index for the producer to continue from and the sample rate
+  std::atomic<int64_t> _read{none};
+  std::atomic<int64_t> _request{none};
+  std::atomic<double> _rate{0.0};
+
+  std::atomic<uint64_t> _hits{0};
+  std::atomic<uint64_t> _misses{0};
+
+  // Owned by the callback
+  RenderedSamples _out;
+  // Owned by the producer
+  RenderedSamples _rendered;
+  int64_t _next = none;
+  // The copy of the active configuration of the slot and the configuration
+  // it was taken of, owned by the producer. Lent to the callback through
+  // _lent, which is nullptr while the callback renders on it.
+  std::unique_ptr<Copy> _copy;
+  Configuration* _copied = nullptr;
+  std::atomic<Copy*> _lent{nullptr};
+  // The hand the producer rendered last, for rendering on the copy
+  HandTracking::TripleBuffer<HandTracking::HandMotion> _motion;
+
+  void lock() {
+    while (_rendering.test_and_set(std::memory_order_acquire)) {
+    }
+  }
+  bool try_lock() {
+    return !_rendering.test_and_set(std::memory_order_acquire);
+  }
+
+  // Copies the active configuration of the slot if it switched, and publishes
+  // its hand. With the flag held, so the slot is not rendered meanwhile.
+  void update_copy() {
+    Configuration* active = _slot.active();
+    if (active == nullptr) {
+      return;
+    }
+    if (active != _copied) {
+      auto copy = std::make_unique<Copy>();
+      copy->config = copy_of(active);
+      copy->render = render_for(active);
+      // Takes the old copy back, once the callback no longer renders on it
+      Copy* expected = _copy.get();
+      while (!_lent.compare_exchange_weak(expected, copy.get(),
+                                          std::memory_order_acq_rel)) {
+        expected = _copy.get();
+        std::this_thread::yield();
+      }
+      _copy = std::move(copy);
+      _copied = active;
+    }
+    _motion.publish(active->hand.getHandMotion());
+  }
+  void unlock() { _rendering.clear(std::memory_order_release); }
+
+  // Copies the samples [first, first + n) from the ring into out, returns
+  // false if any of them is missing
+  bool consume(int64_t first, double rate, size_t n, RenderedSamples& out) {
+    out.start(first, rate, n);
+    for (size_t i = 0; i < n; i++) {
+      const int64_t index = first + (int64_t)i;
+      const Slot& slot = _ring[(size_t)index & _mask];
+      if (slot.index.load(std::memory_order_acquire) != index) {
+        return false;
+      }
+      out.block.x[i] = slot.x.load(std::memory_order_relaxed);
+      out.block.y[i] = slot.y.load(std::memory_order_relaxed);
+      out.block.z[i] = slot.z.load(std::memory_order_relaxed);
+      out.block.intensity[i] = slot.intensity.load(std::memory_order_relaxed);
+      out.hand[i] = slot.hand.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.index.load(std::memory_order_relaxed) != index) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void produce() {
+    while (_running.load(std::memory_order_acquire)) {
+      int64_t request = _request.exchange(none, std::memory_order_acq_rel);
+      if (request != none) {
+        _next = request;
+      }
+      const int64_t read = _read.load(std::memory_order_acquire);
+      if (_next == none || read == none) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        continue;
+      }
+      if (_next < read) {
+        // Fell behind the emitter, skip to where it is
+        _next = read;
+      }
+      if (_next + (int64_t)_block > read + (int64_t)_lead) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        continue;
+      }
+
+      const double rate = _rate.load(std::memory_order_relaxed);
+      lock();
+      _slot.render(_next, rate, _block, _rendered);
+      update_copy();
+      unlock();
+      for (size_t i = 0; i < _block; i++) {
+        const int64_t index = _next + (int64_t)i;
+        Slot& slot = _ring[(size_t)index & _mask];
+        slot.index.store(none, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.x.store(_rendered.block.x[i], std::memory_order_relaxed);
+        slot.y.store(_rendered.block.y[i], std::memory_order_relaxed);
+        slot.z.store(_rendered.block.z[i], std::memory_order_relaxed);
+        slot.intensity.store(_rendered.block.intensity[i],
+                             std::memory_order_relaxed);
+        slot.hand.store(_rendered.hand[i] != 0, std::memory_order_relaxed);
+        slot.index.store(index, std::memory_order_release);
+      }
+      _next += _block;
+    }
+  }
+};
+}  // namespace RandomWalk::Parameters::Engine
@@ -15,6 +15,7 @@
 
 #include "Entries.h"
 #include "HandTracking.h"
+#include "Runtime.h"
 #include "Utils.hpp"
 
 using namespace Ultraleap::Haptics;
@@ -189,8 +190,10 @@ void my_emitter_callback(const StreamingEmitter& emitter,
   // behaviour
   Config* config = static_cast<Config*>(user_pointer);
 
-  // Get a copy of the hand data.
-  HandTracking::LeapOutput leapOutput = config->hand.getLeapOutput();
+  // Get a copy of the recent hand data, the palm is followed to the time of
+  // each sample
+  const HandTracking::HandMotion& motion = config->hand.getHandMotion();
+  HandTracking::LeapOutput leapOutput = motion.at(interval.firstSample());
 
   // Loop through time, setting control point data
   for (TimePointOnOutputInterval& sample : interval) {
@@ -207,9 +210,14 @@ void my_emitter_callback(const StreamingEmitter& emitter,
       offset = config->pattern.evaluate_at(t, config->offsets) +
                Vector3(-20.f, 0.f, 0.f);
     }
+    // The hand may be lost after the start of the interval
+    std::optional<Ultrahaptics::Vector3> palm = motion.palm_at(sample);
+    if (!palm) {
+      sample.controlPoint(0).setIntensity(0.0f);
+      continue;
+    }
     Ultrahaptics::Vector3 position =
-        leapOutput.palm_position +
-        (offset * (leapOutput.hand_is_left ? -1 : 1));
+        palm.value() + (offset * (leapOutput.hand_is_left ? -1 : 1));
 
     const float intensity = config->sine(t);
 
@@ -227,78 +235,30 @@ void my_emitter_callback(const StreamingEmitter& emitter,
 }
 
 int entry(int argc, char* argv[]) {
-#pragma region INIT_DEVICE
-  // Create a Library object and connect it to a running service
-  Library lib;
-  auto found_library = lib.connect();
-
-  /*lib.getLogging().setLogLevel(3);
-  lib.getLogging().redirectLoggingToStdOut();*/
-
-  if (!found_library) {
-    std::cout << "Library failed to connect: "
-              << found_library.error().message() << std::endl;
-    return 1;
-  }
-
-  // Create a streaming emitter and add a suitable device to it
-  StreamingEmitter emitter{lib};
-  auto device = lib.findDevice(DeviceFeatures::StreamingHaptics);
-  if (!device) {
-    std::cout << "Failed to find device: " << device.error().message()
-              << std::endl;
-    return 1;
-  }
-
-  // If we found a device, get the default transform from Leap to Haptics device
-  // space
-  auto transform = device.value().getKitTransform();
-  if (!transform) {
-    std::cerr << "Unknown device transform: " << transform.error().message()
-              << std::endl;
-    return 1;
-  }
-
-  auto add_res = emitter.addDevice(device.value(), transform.value());
-  if (!add_res) {
-    std::cout << "Failed to add device: " << add_res.error().message()
-              << std::endl;
-    return 1;
-  }
-#pragma endregion INIT_DEVICE
-
 #pragma region INIT_LEAP
-  HandTracking::LeapController leap_control;
-
   // Create a structure containing our control point data and fill it in from
   // the file.
   Config point;
 
   point.leap_offset = Vector3(-20.f, 0.f, 0.f);
 
-  leap_control.addListener(point.hand);
 #pragma endregion INIT_LEAP
 
 #pragma region INIT_EMITTER
-  // Get the achievable sample_rate for the number of control points we are
-  // producing
-  auto cp_res = emitter.setControlPointCount(1, AdjustRate::All);
-  if (!cp_res) {
-    std::cout << "Failed to setControlPointCount: " << cp_res.error().message()
-              << std::endl;
+  // Declared after the point, so the emitter is stopped before it is destroyed
+  Streaming::Runtime runtime;
+  if (runtime.init() > 0) {
     return 1;
   }
+  runtime.listen(point.hand);
 
   // Set the callback function to the callback written above
-  auto ec_res = emitter.setEmissionCallback(my_emitter_callback, &point);
-  if (!ec_res) {
-    std::cout << "Failed to setEmissionCallback: " << ec_res.error().message()
-              << std::endl;
+  if (runtime.set_callback(my_emitter_callback, &point) > 0) {
     return 1;
   }
 
   // Start the array
-  emitter.start();
+  runtime.start();
 #pragma endregion INIT_EMITTER
 
   // Wait for enter key to be pressed.
@@ -476,7 +436,7 @@ int entry(int argc, char* argv[]) {
   }
 
   // Stop the array
-  emitter.stop();
+  runtime.stop();
 
   return 0;
 }
@@ -0,0 +1,378 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ultraleap/haptics/streaming.hpp>
+
+namespace RandomWalk::Streaming::Mock {
+using namespace Ultraleap::Haptics;
+
+// A time point of an Interval with the control points to fill, the
+// counterpart of TimePointOnOutputInterval
+class Sample : public LocalTimePoint {
+ public:
+  Sample(const LocalTimePoint& time, ControlPoint* points)
+      : LocalTimePoint(time), _points(points) {}
+
+  ControlPoint& controlPoint(size_t k) { return _points[k]; }
+  const ControlPoint& controlPoint(size_t k) const { return _points[k]; }
+
+ private:
+  ControlPoint* _points;
+};
+
+// The samples of one emission callback, the counterpart of OutputInterval.
+// The samples lie on the sample clock of the emitter, from firstSample() on
+// every iteratorTimeInterval() until intervalEnd().
+class Interval {
+ public:
+  const LocalTimePoint& intervalBegin() const { return _begin; }
+  const LocalTimePoint& intervalEnd() const { return _end; }
+  const LocalTimePoint& firstSample() const { return _first; }
+  const LocalDuration& iteratorTimeInterval() const { return _period; }
+
+  std::vector<Sample>::iterator begin() { return _samples.begin(); }
+  std::vector<Sample>::iterator end() { return _samples.end(); }
+  std::vector<Sample>::const_iterator begin() const { return _samples.begin(); }
+  std::vector<Sample>::const_iterator end() const { return _samples.end(); }
+  size_t size() const { return _samples.size(); }
+
+ private:
+  friend class Emitter;
+
+  LocalTimePoint _begin;
+  LocalTimePoint _end;
+  LocalTimePoint _first;
+  LocalDuration _period;
+  size_t _control_points = 1;
+  std::vector<ControlPoint> _points;
+  std::vector<Sample> _samples;
+
+  // Clears the interval for up to n samples with control_points default
+  // control points each
+  void reset(const LocalTimePoint& begin,
+             const LocalTimePoint& end,
+             const LocalDuration& period,
+             size_t n,
+             size_t control_points) {
+    _begin = begin;
+    _end = end;
+    _first = end;
+    _period = period;
+    _control_points = control_points;
+    _points.assign(n * control_points, ControlPoint());
+    _samples.clear();
+  }
+  void push(const LocalTimePoint& time) {
+    if (_samples.empty()) {
+      _first = time;
+    }
+    _samples.emplace_back(time,
+                          _points.data() + _samples.size() * _control_points);
+  }
+};
+
+// The device a mock Emitter streams to. The update rate of each control point
+// is max_update_rate divided by the control point count, as for an array
+// multiplexing its control points.
+struct Device {
+  std::string identifier = "Mock:0";
+  float max_update_rate = 40000.f;
+  size_t max_control_points = 4;
+};
+
+// One sample as emitted by the mock, recorded for every control point
+struct EmittedPoint {
+  LocalTimePoint time;
+  size_t control_point;
+  ControlPoint point;
+};
+
+// Stands in for the StreamingEmitter without a haptics service or device, so
+// emission callbacks can be run, profiled and load-tested on any machine.
+// It implements the subset of the StreamingEmitter the streaming entries use
+// and calls the callback from its own thread, with a Mock::Interval in place
+// of the OutputInterval. The engine callbacks are templates on the emitter
+// and interval types, e.g. ConfigurationSlot::emitter_callback<Emitter,
+// Interval>.
+//
+// Intervals are callback_rate per second and requested lead ahead of their
+// begin, with the submission deadline transfer before it. All time points are
+// on the LocalTimeClock. At speed 1 the emitter keeps to the wall clock like
+// the real one. A speed above 1 runs the intervals that much faster, and speed
+// 0 back to back: the interval times then run ahead of the wall clock, and
+// only the callback durations of the Instrumentation stats stay meaningful.
+class Emitter {
+ public:
+  using EmissionCallback = void (*)(const Emitter& emitter,
+                                    Interval& interval,
+                                    const LocalTimePoint& submission_deadline,
+                                    void* user_pointer);
+
+  struct Options {
+    double speed = 1.0;
+    float callback_rate = 1000.f;
+    LocalDuration lead = std::chrono::milliseconds(4);
+    LocalDuration transfer = std::chrono::milliseconds(1);
+    // Keep every emitted sample for recorded()
+    bool record = false;
+  };
+
+  Emitter() : Emitter(Options()) {}
+  explicit Emitter(const Options& options) : _options(options) {}
+  Emitter(const Emitter&) = delete;
+  Emitter& operator=(const Emitter&) = delete;
+  ~Emitter() { stop(); }
+
+  result<void> addDevice(const Device& device = Device()) {
+    if (_added || device.max_update_rate <= 0.f ||
+        device.max_control_points == 0) {
+      return make_unexpected(Error(ErrorCode::InvalidArgument));
+    }
+    _device = device;
+    _added = true;
+    _update_rate = device.max_update_rate / _control_points;
+    return {};
+  }
+
+  result<void> setControlPointCount(size_t count, AdjustRate adjust) {
+    if (!_added) {
+      return make_unexpected(Error(ErrorCode::DeviceUnavailable));
+    }
+    if (count == 0 || count > _device.max_control_points) {
+      return make_unexpected(Error(ErrorCode::ArgumentOutOfRange));
+    }
+    if (_thread.joinable()) {
+      return make_unexpected(Error(ErrorCode::InvalidOperation));
+    }
+    const float max_rate = _device.max_update_rate / count;
+    if (adjust == AdjustRate::All ||
+        (adjust == AdjustRate::AsRequired && _update_rate > max_rate)) {
+      _update_rate = max_rate;
+    } else if (_update_rate > max_rate) {
+      return make_unexpected(Error(ErrorCode::ArgumentOutOfRange));
+    }
+    _control_points = count;
+    return {};
+  }
+  result<size_t> getControlPointCount() const { return _control_points; }
+  // Update rate of each control point
+  result<float> getEmitterUpdateRate() const {
+    if (!_added) {
+      return make_unexpected(Error(ErrorCode::DeviceUnavailable));
+    }
+    return _update_rate;
+  }
+
+  // Only while the emitter is stopped
+  result<void> setEmissionCallback(EmissionCallback callback,
+                                   void* user_pointer) {
+    if (_thread.joinable()) {
+      return make_unexpected(Error(ErrorCode::InvalidOperation));
+    }
+    _callback = callback;
+    _user_pointer = user_pointer;
+    return {};
+  }
+
+  result<void> start() {
+    if (!_added) {
+      return make_unexpected(Error(ErrorCode::DeviceUnavailable));
+    }
+    if (_thread.joinable()) {
+      return make_unexpected(Error(ErrorCode::RedundantOperation));
+    }
+    _emitted.clear();
+    _cursor = 0;
+    _iterations = 0;
+    _missed = 0;
+    _running = true;
+    _paused = false;
+    _wall_origin = LocalTimeClock::now();
+    _thread = std::thread(&Emitter::run, this);
+    return {};
+  }
+  result<void> stop() {
+    if (!_thread.joinable()) {
+      return {};
+    }
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _running = false;
+    }
+    _wake.notify_all();
+    _thread.join();
+    return {};
+  }
+  // Stops calling the callback, resume() continues at the current time
+  result<void> pause() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _paused = true;
+    return {};
+  }
+  result<void> resume() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _paused = false;
+    }
+    _wake.notify_all();
+    return {};
+  }
+  bool isPaused() const { return _paused.load(); }
+
+  // Intervals passed to the callback since start(), and those of them whose
+  // callback returned after the submission deadline
+  result<size_t> getCallbackIterations() const { return _iterations.load(); }
+  result<size_t> getMissedCallbackIterations() const { return _missed.load(); }
+
+  // The time the emitter is at, ahead of LocalTimeClock::now() above speed 1
+  LocalTimePoint now() const {
+    LocalTimePoint wall = LocalTimeClock::now();
+    if (_options.speed == 1.0) {
+      return wall;
+    }
+    if (_options.speed <= 0.0) {
+      int64_t cursor = _cursor.load();
+      return cursor != 0 ? LocalTimePoint(LocalDuration(cursor)) : wall;
+    }
+    return _wall_origin +
+           LocalDuration(std::llround((wall - _wall_origin).count() *
+                                      _options.speed));
+  }
+
+  // The samples emitted since start(), only after stop() and with
+  // Options::record
+  const std::vector<EmittedPoint>& recorded() const { return _emitted; }
+  // recorded() as CSV: time in seconds since the first sample, control
+  // point, position and intensity
+  void write_csv(std::ostream& out) const {
+    out << "time,control_point,x,y,z,intensity\n";
+    if (_emitted.empty()) {
+      return;
+    }
+    const LocalTimePoint origin = _emitted.front().time;
+    for (const EmittedPoint& emitted : _emitted) {
+      const Vector3 position = emitted.point.getPosition();
+      out << std::chrono::duration<double>(emitted.time - origin).count()
+          << ',' << emitted.control_point << ',' << position.x << ','
+          << position.y << ',' << position.z << ','
+          << emitted.point.getIntensity() << '\n';
+    }
+  }
+
+ private:
+  Options _options;
+  Device _device;
+  bool _added = false;
+  size_t _control_points = 1;
+  float _update_rate = 0.f;
+  EmissionCallback _callback = nullptr;
+  void* _user_pointer = nullptr;
+
+  std::thread _thread;
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  bool _running = false;
+  std::atomic<bool> _paused{false};
+  LocalTimePoint _wall_origin = LocalTimeClock::now();
+  // Emitter time at speed 0, in nanoseconds since the clock's epoch
+  std::atomic<int64_t> _cursor{0};
+  std::atomic<size_t> _iterations{0};
+  std::atomic<size_t> _missed{0};
+  // Owned by the emitter thread until stop()
+  std::vector<EmittedPoint> _emitted;
+  Interval _interval;
+
+  // Waits until the emitter time reaches time, returns false once stopped.
+  // While paused the wait goes on until resume(), the emitter time then
+  // reached is stored in time.
+  bool wait_until(LocalTimePoint& time) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (_running) {
+      if (_paused) {
+        _wake.wait(lock);
+        if (!_paused) {
+          time = std::max(time, now());
+        }
+        continue;
+      }
+      if (_options.speed <= 0.0) {
+        return true;
+      }
+      LocalTimePoint wall =
+          _wall_origin + LocalDuration(std::llround(
+                             (time - _wall_origin).count() / _options.speed));
+      if (_wake.wait_until(lock, wall) == std::cv_status::timeout) {
+        return _running;
+      }
+    }
+    return false;
+  }
+
+  void run() {
+    const double rate = _update_rate;
+    const LocalDuration period(std::llround(1e9 / rate));
+    const LocalDuration length(std::llround(1e9 / _options.callback_rate));
+    // The sample clock starts at the first interval
+    const LocalTimePoint origin = _wall_origin + _options.lead;
+    int64_t next = 0;
+    LocalTimePoint begin = origin;
+
+    while (true) {
+      LocalTimePoint request = begin - _options.lead;
+      const LocalTimePoint requested = request;
+      if (!wait_until(request)) {
+        return;
+      }
+      if (request > requested) {
+        // Resumed after a pause, continue with the interval due now
+        begin = request + _options.lead;
+        next = std::max(
+            next, (int64_t)std::ceil((begin - origin).count() * rate / 1e9));
+      }
+      const LocalTimePoint end = begin + length;
+      auto time = [&](int64_t index) {
+        return origin + LocalDuration(std::llround(index * (1e9 / rate)));
+      };
+      size_t n = 0;
+      while (time(next + (int64_t)n) < end) {
+        n++;
+      }
+      _cursor.store(request.time_since_epoch().count());
+
+      _interval.reset(begin, end, period, n, _control_points);
+      for (size_t i = 0; i < n; i++) {
+        _interval.push(time(next + (int64_t)i));
+      }
+      const LocalTimePoint deadline = begin - _options.transfer;
+      if (_callback != nullptr) {
+        _callback(*this, _interval, deadline, _user_pointer);
+      }
+      _iterations++;
+      if (_options.speed > 0.0 && now() > deadline) {
+        _missed++;
+      }
+      if (_options.record) {
+        for (Sample& sample : _interval) {
+          for (size_t k = 0; k < _control_points; k++) {
+            _emitted.push_back({sample, k, sample.controlPoint(k)});
+          }
+        }
+      }
+
+      next += (int64_t)n;
+      begin = end;
+    }
+  }
+};
+}  // namespace RandomWalk::Streaming::Mock
@@ -0,0 +1,175 @@
+#include "Modulation.hpp"
+
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define RW_MODULATION_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RW_MODULATION_SSE2
+#endif
+
+namespace RandomWalk::Modulation {
+namespace {
+constexpr double two_pi = 6.283185307179586;
+
+// Taylor coefficients of sin(x), truncation error below 7e-10 on
+// [-pi/2, pi/2]
+constexpr float s3 = -1.6666667e-1f;
+constexpr float s5 = 8.3333333e-3f;
+constexpr float s7 = -1.9841270e-4f;
+constexpr float s9 = 2.7557319e-6f;
+constexpr float s11 = -2.5052108e-8f;
+constexpr float s13 = 1.6059044e-10f;
+
+// sin(x) for x in [-pi/2, pi/2]
+inline float sin_poly(float x) {
+  float x2 = x * x;
+  float p = s13;
+  p = p * x2 + s11;
+  p = p * x2 + s9;
+  p = p * x2 + s7;
+  p = p * x2 + s5;
+  p = p * x2 + s3;
+  return x + x * x2 * p;
+}
+
+// cos(2 * pi * phase) == sin(2 * pi * (0.25 - |r|)) with r the phase reduced
+// to [-0.5, 0.5] turns, which keeps the polynomial argument in [-pi/2, pi/2]
+inline float cos_turns(double phase) {
+  double r = phase - std::nearbyint(phase);
+  return sin_poly((float)((0.25 - std::fabs(r)) * two_pi));
+}
+
+#if defined(RW_MODULATION_AVX2)
+inline __m256 sin_poly(__m256 x) {
+  __m256 x2 = _mm256_mul_ps(x, x);
+  __m256 p = _mm256_set1_ps(s13);
+  p = _mm256_add_ps(_mm256_mul_ps(p, x2), _mm256_set1_ps(s11));
+  p = _mm256_add_ps(_mm256_mul_ps(p, x2), _mm256_set1_ps(s9));
+  p = _mm256_add_ps(_mm256_mul_ps(p, x2), _mm256_set1_ps(s7));
+  p = _mm256_add_ps(_mm256_mul_ps(p, x2), _mm256_set1_ps(s5));
+  p = _mm256_add_ps(_mm256_mul_ps(p, x2), _mm256_set1_ps(s3));
+  return _mm256_add_ps(x, _mm256_mul_ps(_mm256_mul_ps(x, x2), p));
+}
+
+inline __m128 reduce(__m256d phase) {
+  __m256d r = _mm256_sub_pd(
+      phase,
+      _mm256_round_pd(phase, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+  __m256d a = _mm256_andnot_pd(_mm256_set1_pd(-0.0), r);
+  return _mm256_cvtpd_ps(_mm256_mul_pd(
+      _mm256_sub_pd(_mm256_set1_pd(0.25), a), _mm256_set1_pd(two_pi)));
+}
+
+// Envelope for 8 samples given their phases in turns
+inline __m256 envelope(__m256d lo, __m256d hi, __m256 scale) {
+  __m256 x = _mm256_insertf128_ps(_mm256_castps128_ps256(reduce(lo)),
+                                  reduce(hi), 1);
+  __m256 c = sin_poly(x);
+  return _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(1.f), c), scale);
+}
+#elif defined(RW_MODULATION_SSE2)
+// Adding and subtracting 1.5 * 2^52 rounds to the nearest integer (ties to
+// even) for |x| < 2^51, SSE2 has no round instruction
+constexpr double round_magic = 6755399441055744.0;
+
+inline __m128 sin_poly(__m128 x) {
+  __m128 x2 = _mm_mul_ps(x, x);
+  __m128 p = _mm_set1_ps(s13);
+  p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(s11));
+  p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(s9));
+  p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(s7));
+  p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(s5));
+  p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(s3));
+  return _mm_add_ps(x, _mm_mul_ps(_mm_mul_ps(x, x2), p));
+}
+
+inline __m128 reduce(__m128d phase) {
+  const __m128d magic = _mm_set1_pd(round_magic);
+  __m128d r = _mm_sub_pd(phase, _mm_sub_pd(_mm_add_pd(phase, magic), magic));
+  __m128d a = _mm_andnot_pd(_mm_set1_pd(-0.0), r);
+  return _mm_cvtpd_ps(
+      _mm_mul_pd(_mm_sub_pd(_mm_set1_pd(0.25), a), _mm_set1_pd(two_pi)));
+}
+
+// Envelope for 4 samples given their phases in turns
+inline __m128 envelope(__m128d lo, __m128d hi, __m128 scale) {
+  __m128 x = _mm_movelh_ps(reduce(lo), reduce(hi));
+  __m128 c = sin_poly(x);
+  return _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(1.f), c), scale);
+}
+#endif
+}  // namespace
+
+void raised_cosine(const float* t,
+                   size_t n,
+                   float frequency,
+                   float gain,
+                   float* out) {
+  const float half_gain = 0.5f * gain;
+  size_t i = 0;
+#if defined(RW_MODULATION_AVX2)
+  const __m256d f = _mm256_set1_pd(frequency);
+  const __m256 scale = _mm256_set1_ps(half_gain);
+  for (; i + 8 <= n; i += 8) {
+    __m256 ts = _mm256_loadu_ps(t + i);
+    __m256d lo =
+        _mm256_mul_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(ts)), f);
+    __m256d hi =
+        _mm256_mul_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(ts, 1)), f);
+    _mm256_storeu_ps(out + i, envelope(lo, hi, scale));
+  }
+#elif defined(RW_MODULATION_SSE2)
+  const __m128d f = _mm_set1_pd(frequency);
+  const __m128 scale = _mm_set1_ps(half_gain);
+  for (; i + 4 <= n; i += 4) {
+    __m128 ts = _mm_loadu_ps(t + i);
+    __m128d lo = _mm_mul_pd(_mm_cvtps_pd(ts), f);
+    __m128d hi = _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(ts, ts)), f);
+    _mm_storeu_ps(out + i, envelope(lo, hi, scale));
+  }
+#endif
+  for (; i < n; i++) {
+    out[i] = (1.f - cos_turns((double)t[i] * frequency)) * half_gain;
+  }
+}
+
+void raised_cosine(double phase,
+                   double step,
+                   size_t n,
+                   float gain,
+                   float* out) {
+  const float half_gain = 0.5f * gain;
+  size_t i = 0;
+#if defined(RW_MODULATION_AVX2)
+  const __m256d base = _mm256_set1_pd(phase);
+  const __m256d steps = _mm256_set1_pd(step);
+  const __m256 scale = _mm256_set1_ps(half_gain);
+  for (; i + 8 <= n; i += 8) {
+    const double k = (double)i;
+    __m256d lo = _mm256_add_pd(
+        base, _mm256_mul_pd(_mm256_set_pd(k + 3, k + 2, k + 1, k), steps));
+    __m256d hi = _mm256_add_pd(
+        base, _mm256_mul_pd(_mm256_set_pd(k + 7, k + 6, k + 5, k + 4), steps));
+    _mm256_storeu_ps(out + i, envelope(lo, hi, scale));
+  }
+#elif defined(RW_MODULATION_SSE2)
+  const __m128d base = _mm_set1_pd(phase);
+  const __m128d steps = _mm_set1_pd(step);
+  const __m128 scale = _mm_set1_ps(half_gain);
+  for (; i + 4 <= n; i += 4) {
+    const double k = (double)i;
+    __m128d lo = _mm_add_pd(base, _mm_mul_pd(_mm_set_pd(k + 1, k), steps));
+    __m128d hi = _mm_add_pd(base, _mm_mul_pd(_mm_set_pd(k + 3, k + 2), steps));
+    _mm_storeu_ps(out + i, envelope(lo, hi, scale));
+  }
+#endif
+  for (; i < n; i++) {
+    out[i] = (1.f - cos_turns(phase + i * step)) * half_gain;
+  }
+}
+
+}  // namespace RandomWalk::Modulation
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+
+namespace RandomWalk::Modulation {
+
+// Raised-cosine amplitude modulation envelope,
+//   out[i] = (1 - cos(2 * pi * frequency * t[i])) * 0.5 * gain,
+// evaluated for n sample times (in seconds) at once.
+//
+// Uses AVX2 when compiled with /arch:AVX2 (-mavx2), SSE2 otherwise and a
+// scalar loop on other targets; all three paths compute the same
+// approximation. The phase f * t is reduced to [-0.5, 0.5] turns in double
+// precision, so long session times do not lose phase, and the cosine is a
+// degree 13 polynomial in single precision. Against
+// Parameters::Configuration::sine the absolute error is below 4e-7 * gain
+// (2^-21) for |f * t| < 2^31.
+void raised_cosine(const float* t,
+                   size_t n,
+                   float frequency,
+                   float gain,
+                   float* out);
+
+// The same envelope on the sample clock: sample i is at phase + i * step
+// turns, with phase and step from a Time::PhaseAccumulator. Reducing the
+// phase exactly before the call keeps the result independent of the session
+// length; the error bound above holds for |phase + n * step| < 2^31.
+void raised_cosine(double phase,
+                   double step,
+                   size_t n,
+                   float gain,
+                   float* out);
+
+}  // namespace RandomWalk::Modulation
@@ -5,9 +5,13 @@
 #include <cstdlib>
 #include <map>
 #include <optional>
+#include <random>
+#include <vector>
 
 #include "ExploringSensationLibrary.h"
 #include "HandTracking.h"
+#include "Modulation.hpp"
+#include "SampleClock.hpp"
 #include "Utils.hpp"
 #include "json.hpp"
 
@@ -17,19 +21,81 @@ using json = nlohmann::json;
 
 namespace RandomWalk::Parameters {
 
+// Contiguous per-interval sample storage. The emitter callback starts the
+// block at the sample index of the first sample of an OutputInterval and
+// pushes one entry per sample, Configuration::evaluate_block fills the
+// positions (x, y, z) and intensities. Sample i sits at index first + i of a
+// clock running at rate samples per second, see Time::SampleClock. Capacity
+// is kept between intervals so the streaming path does not allocate once
+// warmed up.
+struct SampleBlock {
+  int64_t first = 0;
+  double rate = 0;
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  std::vector<float> intensity;
+  size_t size = 0;
+
+  void clear() { size = 0; }
+  void start(int64_t first_index, double sample_rate) {
+    clear();
+    first = first_index;
+    rate = sample_rate;
+  }
+  void push() {
+    if (size == x.size()) {
+      size_t capacity = std::max<size_t>(64, 2 * size);
+      x.resize(capacity);
+      y.resize(capacity);
+      z.resize(capacity);
+      intensity.resize(capacity);
+    }
+    size++;
+  }
+  int64_t index(size_t i) const { return first + (int64_t)i; }
+  // Time of sample i since the clock origin, for the per-sample API
+  Seconds time(size_t i) const { return Seconds(index(i) / rate); }
+  void set_position(size_t i, const Ultrahaptics::Vector3& position) {
+    x[i] = position.x;
+    y[i] = position.y;
+    z[i] = position.z;
+  }
+  void fill_position(const Ultrahaptics::Vector3& position) {
+    std::fill_n(x.begin(), size, position.x);
+    std::fill_n(y.begin(), size, position.y);
+    std::fill_n(z.begin(), size, position.z);
+  }
+};
+
 class Configuration {
  public:
   Configuration(float intensity = 1.f,
                 int frequency = 256,
                 float duration = 256)
       : _intensity(intensity), _frequency(frequency), _duration(duration) {}
+  // Copies the parameters and the evaluation state, the copy has a hand
+  // listener of its own that no frames were published to
+  Configuration(const Configuration& other)
+      : block(other.block),
+        _intensity(other._intensity),
+        _frequency(other._frequency),
+        _duration(other._duration),
+        _started(other._started),
+        _started_sample(other._started_sample),
+        _delay(other._delay),
+        _palm_position(other._palm_position) {}
+  Configuration& operator=(const Configuration&) = delete;
+  virtual ~Configuration() = default;
   HandTracking::LeapListening hand;
+  SampleBlock block;
 
  private:
   float _intensity;
   int _frequency;
   float _duration;
   std::optional<Seconds> _started;
+  std::optional<int64_t> _started_sample;
   float _delay = 1.f;
 
  protected:
@@ -59,6 +125,7 @@ class Configuration {
     if (_started.has_value()) {
       _started.reset();
     }
+    _started_sample.reset();
   }
   float evaluate_intensity(Seconds t) {
     float t_intensity = 0.f;
@@ -71,6 +138,50 @@ class Configuration {
   virtual Ultrahaptics::Vector3 evaluate_position(
       Seconds t,
       HandTracking::LeapOutput* leapOutput) = 0;
+
+  // Block counterparts of evaluate_position/evaluate_intensity, evaluating all
+  // block.size samples of an interval in one call.
+  void evaluate_block(SampleBlock& block,
+                      HandTracking::LeapOutput* leapOutput) {
+    evaluate_positions(block, leapOutput);
+    evaluate_intensities(block);
+  }
+  virtual void evaluate_positions(SampleBlock& block,
+                                  HandTracking::LeapOutput* leapOutput) {
+    for (size_t i = 0; i < block.size; i++) {
+      block.set_position(i, evaluate_position(block.time(i), leapOutput));
+    }
+  }
+  void evaluate_intensities(SampleBlock& block) {
+    size_t playing = playing_samples(block);
+    intensity_modulation(block, playing);
+    std::fill(block.intensity.begin() + playing,
+              block.intensity.begin() + block.size, 0.f);
+  }
+  // Number of leading samples of the block that fall inside the playtime. The
+  // playtime starts at the first sample evaluated after a reset and includes
+  // the sample duration() milliseconds later.
+  size_t playing_samples(SampleBlock& block) {
+    if (block.size == 0) {
+      return 0;
+    }
+    if (!_started_sample.has_value()) {
+      _started_sample = block.first;
+    }
+    int64_t end = _started_sample.value() +
+                  std::llround(duration() / 1000 * block.rate);
+    int64_t playing = end - block.first + 1;
+    return (size_t)std::clamp<int64_t>(playing, 0, block.size);
+  }
+  // Fills the intensities of the first n samples of the block
+  virtual void intensity_modulation(SampleBlock& block, size_t n) {
+    // vectorised sine(), see Modulation::raised_cosine for the accuracy
+    auto phase =
+        Time::PhaseAccumulator::from_frequency(frequency(), block.rate);
+    phase.seek(block.first);
+    Modulation::raised_cosine(phase.fraction(), phase.step(), n, intensity(),
+                              block.intensity.data());
+  }
   virtual void pre_hook(HandTracking::LeapOutput* leapOutput, int sample_rate) {
   }
 
@@ -100,6 +211,10 @@ class Point : public Configuration {
   Ultrahaptics::Vector3 evaluate_position(Seconds t) override {
     return offset();
   };
+  void evaluate_positions(SampleBlock& block,
+                          HandTracking::LeapOutput* leapOutput) override {
+    block.fill_position(offset());
+  }
 
   const Ultrahaptics::Vector3& offset() const { return _offset; }
   void offset(const Ultrahaptics::Vector3& offset) { _offset = offset; }
@@ -147,6 +262,38 @@ class Brush : public Point {
     _last_fraction = fraction;
     return Point::evaluate_position(t) + position;
   }
+  void evaluate_positions(SampleBlock& block,
+                          HandTracking::LeapOutput* leapOutput) override {
+    // Utils::lerp(A, B, f) == B + (A - B) * f
+    const Ultrahaptics::Vector3 base = offset() + _endpointXB;
+    const Ultrahaptics::Vector3 sweep = _endpointXA - _endpointXB;
+    const Ultrahaptics::Vector3 height_base = _endpointYB;
+    const Ultrahaptics::Vector3 height_sweep = _endpointYA - _endpointYB;
+    const bool sweep_height = _height > 1.f;
+    auto sweep_phase =
+        Time::PhaseAccumulator::from_frequency(_width_frequency, block.rate);
+    sweep_phase.seek(block.first);
+    for (size_t i = 0; i < block.size; i++) {
+      float fraction = (float)sweep_phase.fraction();
+      sweep_phase.advance();
+      float x = base.x + sweep.x * fraction;
+      float y = base.y + sweep.y * fraction;
+      float z = base.z + sweep.z * fraction;
+      if (sweep_height) {
+        if (_last_fraction > fraction) {
+          _height_fraction += _height_sec;
+          _height_fraction = _height_fraction > 1 ? 0 : _height_fraction;
+        }
+        x += height_base.x + height_sweep.x * _height_fraction;
+        y += height_base.y + height_sweep.y * _height_fraction;
+        z += height_base.z + height_sweep.z * _height_fraction;
+      }
+      _last_fraction = fraction;
+      block.x[i] = x;
+      block.y[i] = y;
+      block.z[i] = z;
+    }
+  }
   void pre_hook(HandTracking::LeapOutput* leapOutput,
                 int sample_rate) override {
     _endpointXA = leapOutput->palm_position - _displacementX;
@@ -239,6 +386,92 @@ enum class BoneIdx {
   TIP = 3,
 };
 
+// A trajectory of points stepped through at a fixed frequency, compiled into
+// structure-of-arrays form with the configuration offset folded in. Streaming
+// keeps a cursor into the table and an integer accumulator for the samples
+// per step, so each sample is an accumulator increment and a table read.
+class PointSequence {
+ public:
+  void compile(const std::vector<Ultrahaptics::Vector3>& points,
+               const Ultrahaptics::Vector3& offset) {
+    _x.clear();
+    _y.clear();
+    _z.clear();
+    for (auto& point : points) {
+      _x.push_back(offset.x + point.x);
+      _y.push_back(offset.y + point.y);
+      _z.push_back(offset.z + point.z);
+    }
+    _offset = offset;
+    _next.reset();
+  }
+  // Moves the compiled trajectory to a new offset
+  void offset(const Ultrahaptics::Vector3& offset) {
+    Ultrahaptics::Vector3 shift = offset - _offset;
+    for (size_t i = 0; i < size(); i++) {
+      _x[i] += shift.x;
+      _y[i] += shift.y;
+      _z[i] += shift.z;
+    }
+    _offset = offset;
+  }
+  // Precomputes the samples per step, called from the pre_hook with the
+  // emitter rate
+  void timing(float step_frequency, int sample_rate) {
+    if (sample_rate == _sample_rate && step_frequency == _step_frequency) {
+      return;
+    }
+    _steps = Time::PhaseAccumulator::from_frequency(step_frequency, sample_rate);
+    _step_frequency = step_frequency;
+    _sample_rate = sample_rate;
+    _next.reset();
+  }
+
+  size_t size() const { return _x.size(); }
+  const Ultrahaptics::Vector3& offset() const { return _offset; }
+  Ultrahaptics::Vector3 at(size_t idx) const {
+    return Ultrahaptics::Vector3(_x[idx], _y[idx], _z[idx]);
+  }
+
+  void evaluate(SampleBlock& block) {
+    const size_t n = size();
+    if (n == 0) {
+      block.fill_position(_offset);
+      return;
+    }
+    if (_sample_rate == 0) {
+      timing(_step_frequency, (int)std::lround(block.rate));
+    }
+    // reposition the cursor only if the block does not continue the last one
+    if (!_next.has_value() || _next.value() != block.first) {
+      _idx = (size_t)(_steps.cycles(block.first) % (int64_t)n);
+      _steps.seek(block.first);
+    }
+    size_t idx = _idx;
+    for (size_t i = 0; i < block.size; i++) {
+      block.x[i] = _x[idx];
+      block.y[i] = _y[idx];
+      block.z[i] = _z[idx];
+      if (int64_t completed = _steps.advance()) {
+        idx = (idx + (size_t)completed) % n;
+      }
+    }
+    _idx = idx;
+    _next = block.first + (int64_t)block.size;
+  }
+
+ private:
+  std::vector<float> _x;
+  std::vector<float> _y;
+  std::vector<float> _z;
+  Ultrahaptics::Vector3 _offset;
+  float _step_frequency = 0;
+  int _sample_rate = 0;
+  Time::PhaseAccumulator _steps;
+  size_t _idx = 0;
+  std::optional<int64_t> _next;
+};
+
 class Ripple : public Point {
  public:
   Ripple(float intensity,
@@ -252,22 +485,38 @@ class Ripple : public Point {
         _num_points(num_points),
         _boundaries(boundaries),
         _jump_frequency(jump_frequency) {
-    std::srand(_seed);
+    // The offsets std::srand(_seed) and std::rand() gave with the MSVC
+    // runtime the studies were recorded with, from a local generator that
+    // leaves the global std::rand state alone
+    Utils::MsvcRand generator(_seed);
     int width = std::get<0>(boundaries);
     int height = std::get<1>(boundaries);
+    std::vector<Ultrahaptics::Vector3> offsets;
     for (size_t i = 0; i < _num_points; i++) {
-      float w = (std::rand() % width) - width;
-      float h = (std::rand() % height) - height;
+      float w = (generator() % width) - width;
+      float h = (generator() % height) - height;
       offsets.emplace_back(w, 0, h);
     }
     /*Utils::print_vector(offsets);*/
+    _sequence.compile(offsets, offset);
+    _sequence.timing(_jump_frequency, 0);
   }
   Ultrahaptics::Vector3 evaluate_position(
       Seconds t,
       HandTracking::LeapOutput* leapOutput) override {
     int idx = (int)floor(t.count() / (1 / _jump_frequency)) % _num_points;
-    Ultrahaptics::Vector3 position = offsets[idx];
-    return Point::evaluate_position(t) + position;
+    return _sequence.at(idx);
+  }
+  void evaluate_positions(SampleBlock& block,
+                          HandTracking::LeapOutput* leapOutput) override {
+    _sequence.evaluate(block);
+  }
+  void pre_hook(HandTracking::LeapOutput* leapOutput,
+                int sample_rate) override {
+    if (!(_sequence.offset() == offset())) {
+      _sequence.offset(offset());
+    }
+    _sequence.timing(_jump_frequency, sample_rate);
   }
   std::string to_json() override {
     json j = {{"name", "Ripple"},         {"intensity", intensity()},
@@ -281,7 +530,7 @@ class Ripple : public Point {
   unsigned int _seed = 42;
   int _num_points;
   std::tuple<float, float> _boundaries;
-  std::vector<Ultrahaptics::Vector3> offsets;
+  PointSequence _sequence;
   float _jump_frequency;
 };
 
@@ -310,6 +559,7 @@ class Square : public Point {
     /*Utils::print_vector(ws);
     Utils::print_vector(hs);*/
 
+    std::vector<Ultrahaptics::Vector3> points;
     std::vector<Ultrahaptics::Vector3> _points;
     std::function<void(int, int, int, int)> append;
     append = [_points, ws, hs, &append](int i, int j, int m, int n) mutable {
@@ -371,15 +621,31 @@ class Square : public Point {
       default:
         break;
     }
+    _sequence.compile(points, offset);
+    _sequence.timing(_jump_frequency, 0);
   }
   Ultrahaptics::Vector3 evaluate_position(
       Seconds t,
       HandTracking::LeapOutput* leapOutput) override {
-    int idx = (int)floor(t.count() / (1 / _jump_frequency)) % points.size();
-    Ultrahaptics::Vector3 position = points[idx];
-    return Point::evaluate_position(t) + position;
+    int idx =
+        (int)floor(t.count() / (1 / _jump_frequency)) % _sequence.size();
+    return _sequence.at(idx);
+  }
+  void evaluate_positions(SampleBlock& block,
+                          HandTracking::LeapOutput* leapOutput) override {
+    _sequence.evaluate(block);
+  }
+  void pre_hook(HandTracking::LeapOutput* leapOutput,
+                int sample_rate) override {
+    if (!(_sequence.offset() == offset())) {
+      _sequence.offset(offset());
+    }
+    _sequence.timing(_jump_frequency, sample_rate);
   }
   float intensity_modulation(Seconds t) override { return intensity(); }
+  void intensity_modulation(SampleBlock& block, size_t n) override {
+    std::fill_n(block.intensity.begin(), n, intensity());
+  }
   std::string to_json() override {
     json j = {{"name", "Square"},         {"intensity", intensity()},
               {"frequency", frequency()}, {"duration", duration()},
@@ -390,7 +656,7 @@ class Square : public Point {
 
  private:
   std::tuple<float, float> _boundaries;
-  std::vector<Ultrahaptics::Vector3> points;
+  PointSequence _sequence;
   float _jump_frequency;
 };
 
@@ -423,12 +689,32 @@ class TrackedPoint : public Point {
     int idx = (int)floor(ms / duration()) % len;
 
     auto finger_bone = _indicies[idx];
-    auto tracking = HandTracking::translate_finger_output(leapOutput);
+    const HandTracking::BoneMatrix& tracking =
+        HandTracking::translate_finger_output(leapOutput);
 
     return Point::evaluate_position(t) +
            tracking[(int)std::get<0>(finger_bone)]
                    [(int)std::get<1>(finger_bone)];
   };
+  void evaluate_positions(SampleBlock& block,
+                          HandTracking::LeapOutput* leapOutput) override {
+    const HandTracking::BoneMatrix& tracking =
+        HandTracking::translate_finger_output(leapOutput);
+    const Ultrahaptics::Vector3& base = offset();
+    const auto steps =
+        Time::PhaseAccumulator::from_period_ms(duration(), block.rate);
+    const int64_t len = _indicies.size();
+    for (size_t i = 0; i < block.size; i++) {
+      int idx = (int)(steps.cycles(block.index(i)) % len);
+      auto finger_bone = _indicies[idx];
+      const Ultrahaptics::Vector3& position =
+          tracking[(int)std::get<0>(finger_bone)]
+                  [(int)std::get<1>(finger_bone)];
+      block.x[i] = base.x + position.x;
+      block.y[i] = base.y + position.y;
+      block.z[i] = base.z + position.z;
+    }
+  }
   std::string to_json() override {
     json j = {
         {"name", "TrackedPoint"},   {"intensity", intensity()},
@@ -500,6 +786,22 @@ class Pattern {
     // std::cout << std::get<0>(p) << std::get<1>(p) << std::endl;
     return offsets[std::get<0>(p)][std::get<1>(p)];
   }
+  void evaluate_at(Parameters::SampleBlock& block,
+                   Ultrahaptics::Vector3 offsets[cells][cells],
+                   const Ultrahaptics::Vector3& shift) {
+    const auto steps =
+        Time::PhaseAccumulator::from_period_ms(duration(), block.rate);
+    const int64_t len = pattern.size();
+    for (size_t i = 0; i < block.size; i++) {
+      int idx = (int)(steps.cycles(block.index(i)) % len);
+      auto p = pattern[idx];
+      const Ultrahaptics::Vector3& offset =
+          offsets[std::get<0>(p)][std::get<1>(p)];
+      block.x[i] = offset.x + shift.x;
+      block.y[i] = offset.y + shift.y;
+      block.z[i] = offset.z + shift.z;
+    }
+  }
 };
 
 class ULtBR : public Pattern {
@@ -624,6 +926,15 @@ class Config : public Parameters::Configuration {
       HandTracking::LeapOutput* leapOutput) {
     return evaluate_position(t);
   }
+  void evaluate_positions(Parameters::SampleBlock& block,
+                          HandTracking::LeapOutput* leapOutput) override {
+    if (mode == RenderMode::STATIC) {
+      block.fill_position(leap_offset);
+    } else if (mode == RenderMode::DYNAMIC) {
+      pattern.evaluate_at(block, offsets,
+                          Ultrahaptics::Vector3(-20.f, 0.f, 0.f));
+    }
+  }
   std::string to_json() override {
     json j = {
         {"name", pattern.name()},         {"intensity", intensity()},
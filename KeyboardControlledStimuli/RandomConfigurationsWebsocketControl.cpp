@@ -1,6 +1,7 @@
 #include <conio.h>
 #include <iostream>
 #include <map>
+#include <optional>
 #include <string>
 #include <ultraleap/haptics/streaming.hpp>
 #include <utility>
@@ -9,159 +10,126 @@
 #include "easywsclient.hpp"
 
 #include "Parameters.h"
+#include "Runtime.h"
 #include "Utils.hpp"
 
+#include "ConfigurationSlot.h"
 #include "Configurations.h"
+#include "Engine.h"
+#include "LookAhead.h"
+#include "TrialSampler.hpp"
 
 using namespace Ultraleap::Haptics;
 
-using Seconds = std::chrono::duration<float>;
-
-static auto start_time = std::chrono::steady_clock::now();
-
 static easywsclient::WebSocket::pointer ws = NULL;
 
 namespace RandomWalk::Parameters::Websockets {
-// Callback function for filling out complete device output states through time
-void emitter_callback(const StreamingEmitter& emitter,
-                      OutputInterval& interval,
-                      const LocalTimePoint& submission_deadline,
-                      void* user_pointer) {
-  // Cast the user pointer to the struct that describes the control point
-  // behaviour
-  Configuration* config = static_cast<Configuration*>(user_pointer);
-
-  // Get a copy of the hand data.
-  HandTracking::LeapOutput leapOutput = config->hand.getLeapOutput();
-  config->pre_hook(&leapOutput, emitter.getCallbackRate());
-
-  // Loop through time, setting control point data
-  for (TimePointOnOutputInterval& sample : interval) {
-    if (!leapOutput.hand_present) {
-      sample.controlPoint(0).setIntensity(0.0f);
-      config->reset_playtime();
-      continue;
-    }
-
-    const Seconds t = sample - start_time;
-    Ultrahaptics::Vector3 offset = config->evaluate_position(t, &leapOutput);
-    Ultrahaptics::Vector3 position;
-    if (config->palm_position()) {
-      position = leapOutput.palm_position;
-    }
-    position += (offset * (leapOutput.hand_is_left ? -1.f : 1.f));
-
-    const float intensity = config->evaluate_intensity(t);
-
-    // Project the control point onto the palm
-    sample.controlPoint(0).setPosition(position);
-
-    // Set the intensity of the point using the waveform. If the hand is not
-    // present, intensity is 0.
-    sample.controlPoint(0).setIntensity(intensity);
-  }
-}
-
 void print_message(const std::string& message) {
   printf(">>> %s\n", message.c_str());
 }
 
 int entry(int argc, char* argv[]) {
-#pragma region INIT_DEVICE
-  // Create a Library object and connect it to a running service
-  Library lib;
-  auto found_library = lib.connect();
-
-  /*lib.getLogging().setLogLevel(3);
-  lib.getLogging().redirectLoggingToStdOut();*/
-
-  if (!found_library) {
-    std::cout << "Library failed to connect: "
-              << found_library.error().message() << std::endl;
-    return 1;
-  }
-
-  // Create a streaming emitter and add a suitable device to it
-  StreamingEmitter emitter{lib};
-  auto device = lib.findDevice(DeviceFeatures::StreamingHaptics);
-  if (!device) {
-    std::cout << "Failed to find device: " << device.error().message()
-              << std::endl;
-    return 1;
-  }
-
-  // If we found a device, get the default transform from Leap to Haptics device
-  // space
-  auto transform = device.value().getKitTransform();
-  if (!transform) {
-    std::cerr << "Unknown device transform: " << transform.error().message()
-              << std::endl;
-    return 1;
-  }
-
-  auto add_res = emitter.addDevice(device.value(), transform.value());
-  if (!add_res) {
-    std::cout << "Failed to add device: " << add_res.error().message()
-              << std::endl;
-    return 1;
-  }
-
-  // Get the achievable sample_rate for the number of control points we are
-  // producing
-  auto cp_res = emitter.setControlPointCount(1, AdjustRate::All);
-  if (!cp_res) {
-    std::cout << "Failed to setControlPointCount: " << cp_res.error().message()
-              << std::endl;
-    return 1;
-  }
-#pragma endregion
-
 #pragma region INIT_WS
   const std::string ws_url = "ws://localhost:8081/";
   ws = easywsclient::WebSocket::from_url(ws_url);
 #pragma endregion
 
   std::cout << "Hit ENTER to quit..." << std::endl;
+  std::cout << "Send \"stmstats\" for the callback timings" << std::endl;
   // std::cout << "Hit 5 and 6 to regulate frequency" << std::endl;
   // std::cout << "Hit 7 and 8 to regulate intensity" << std::endl;
   // std::cout << "Hit 5 and 6 to regulate position" << std::endl;
   // std::cout << "Hit 7 and 8 to regulate position y" << std::endl;
 
-  HandTracking::LeapController leap_control;
   Configurations::Configurations configurations;
 
-  std::vector<std::string> already_applied = {};
-  already_applied.reserve(configurations.size());
-
-  Configuration* point;
+  // Optional arguments: a seed to replay the order of a session, and
+  // --look-ahead to render the samples ahead of the emitter on a producer
+  // thread
+  std::optional<uint64_t> seed;
+  bool look_ahead = false;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--look-ahead") {
+      look_ahead = true;
+    } else if (!(seed = Utils::parse_seed(arg))) {
+      std::cout << "Usage: " << argv[0] << " [--look-ahead] [seed]"
+                << std::endl;
+      return 1;
+    }
+  }
+  Utils::TrialSampler sampler =
+      seed ? Utils::TrialSampler(configurations.size(), seed.value())
+           : Utils::TrialSampler(configurations.size());
+  std::cout << "Trial order seed: " << sampler.seed() << std::endl;
+
+  // The configuration streamed by the emitter callback, trials are switched
+  // through it while the emitter keeps running
+  Engine::ConfigurationSlot slot;
+  Engine::LookAhead producer(slot);
+  Configuration* point = nullptr;
+
+  // Declared after the slot and the configurations, so the emitter is stopped
+  // and the listeners removed before they are destroyed
+  Streaming::Runtime runtime;
+  if (runtime.init() > 0) {
+    return 1;
+  }
 
-  auto next_configuration = [configurations, &already_applied, leap_control,
-                             &emitter, point]() mutable {
+  auto next_configuration = [&configurations, &sampler, &runtime, &slot,
+                             &look_ahead, &producer, &point]() {
     // Create a structure containing our control point data and fill it in from
-    // the file.
-    std::tuple<std::string, Configuration*> config =
-        configurations.get_random(already_applied);
-    auto m_key = std::get<std::string>(config);
-    already_applied.push_back(m_key);
+    // the file. It is built next to the running one.
+    size_t index = sampler.next();
+    auto m_key = configurations.get_key(index);
     std::cout << "Now playing: " << m_key << std::endl;
-    point = std::get<Configuration*>(config);
-
-    leap_control.addListener(point->hand);
-
-    // Set the callback function to the callback written above
-    auto ec_res = emitter.setEmissionCallback(emitter_callback, point);
-    if (!ec_res) {
-      std::cout << "Failed to setEmissionCallback: " << ec_res.error().message()
-                << std::endl;
-      return 1;
+    Configuration* next = configurations.build_next(index);
+
+    runtime.listen(next->hand);
+
+    if (point == nullptr) {
+      // First trial, the emitter is not started yet
+      if (!slot.set(next)) {
+        std::cout << "No renderer for " << m_key << std::endl;
+        return 1;
+      }
+      int ok = look_ahead ? runtime.set_callback(
+                                Engine::LookAhead::emitter_callback, &producer)
+                          : runtime.set_callback(
+                                Engine::ConfigurationSlot::emitter_callback,
+                                &slot);
+      if (ok > 0) {
+        return ok;
+      }
+    } else {
+      // The new listener needs a frame first, the hand would be missing
+      // and the configuration silent until the next one otherwise
+      if (!runtime.wait_for_frame(next->hand)) {
+        std::cout << "No hand frame for " << m_key << " yet" << std::endl;
+      }
+      // The callback switches at the start of its next interval, then the
+      // previous trial is ended and its configuration released by the
+      // registry
+      if (!slot.stage(next)) {
+        std::cout << "Failed to stage " << m_key << std::endl;
+        return 1;
+      }
+      Configuration* previous = slot.reclaim();
+      if (previous == nullptr) {
+        std::cout << "Emitter did not switch to " << m_key << std::endl;
+        return 1;
+      }
+      runtime.unlisten(previous->hand);
+      configurations.release(previous);
     }
+    point = next;
 
     std::cout << point->to_json() << std::endl;
-    Utils::print_element(already_applied);
+    std::cout << "Trial " << sampler.position() << "/" << sampler.size()
+              << std::endl;
     ws->send("stm" + point->to_json());
 
-    if (configurations.size() == already_applied.size()) {
-      already_applied = {};
+    if (sampler.exhausted()) {
       std::cout << "Restart from the beginning --------------- " << std::endl;
     }
     return 0;
@@ -172,27 +140,40 @@ int entry(int argc, char* argv[]) {
   }
 
   // Start the array
-  emitter.start();
+  if (look_ahead) {
+    producer.start();
+  }
+  runtime.start();
 
   // Wait for enter key to be pressed.
   while (ws->getReadyState() != easywsclient::WebSocket::CLOSED) {
     ws->poll();
     ws->dispatch(
-        [next_configuration, &emitter](const std::string& message) mutable {
+        [&next_configuration, &runtime](const std::string& message) {
           if (message == "\"stmnext\"") {
-            emitter.pause();
-
             int ok = next_configuration();
             if (ok > 0) {
               return ok;
             }
-            emitter.resume();
+          } else if (message == "\"stmstats\"") {
+            // Callback timings, see Instrumentation::CallbackStats
+            ws->send("sts" + runtime.stats().to_json().dump());
           }
         });
   }
 
   // Stop the array
-  emitter.stop();
+  runtime.stop();
+  producer.stop();
+  runtime.stats().print(std::cout);
+  if (look_ahead) {
+    std::cout << "Look-ahead intervals: " << producer.hits()
+              << ", rendered in the callback: " << producer.misses()
+              << std::endl;
+  }
+  if (point != nullptr) {
+    runtime.unlisten(point->hand);
+  }
 
   return 0;
 }
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#include <ultraleap/haptics/streaming.hpp>
+
+#include "HandStream.hpp"
+#include "HandTracking.h"
+#include "Instrumentation.hpp"
+
+namespace RandomWalk::Streaming {
+using namespace Ultraleap::Haptics;
+
+// The device side of a streaming entry: connects to the haptics service, adds
+// the first streaming device with its kit transform, negotiates the control
+// point count and owns the hand stream, the Leap controller or a replayed hand
+// recording as given by the hand options. Every callback is installed behind
+// an InstrumentedCallback, so all entries report their interval timings the
+// same way.
+//
+// Declare the runtime after the listeners and callback data it is given, it
+// stops the emitter and removes the listeners when destroyed.
+class Runtime {
+ public:
+  Runtime() = default;
+  Runtime(const Runtime&) = delete;
+  Runtime& operator=(const Runtime&) = delete;
+  ~Runtime() { stop(); }
+
+  // Connects to the service and sets up the device for control_points
+  // control points. Returns 0 on success, 1 after printing the reason.
+  int init(size_t control_points = 1) {
+    if (_hands.open() > 0) {
+      return 1;
+    }
+
+    // Create a Library object and connect it to a running service
+    auto found_library = _library.connect();
+    if (!found_library) {
+      std::cout << "Library failed to connect: "
+                << found_library.error().message() << std::endl;
+      return 1;
+    }
+
+    // Create a streaming emitter and add a suitable device to it
+    _emitter = std::make_unique<StreamingEmitter>(_library);
+    auto device = _library.findDevice(DeviceFeatures::StreamingHaptics);
+    if (!device) {
+      std::cout << "Failed to find device: " << device.error().message()
+                << std::endl;
+      return 1;
+    }
+
+    // If we found a device, get the default transform from Leap to Haptics
+    // device space
+    auto transform = device.value().getKitTransform();
+    if (!transform) {
+      std::cerr << "Unknown device transform: "
+                << transform.error().message() << std::endl;
+      return 1;
+    }
+
+    auto add_res = _emitter->addDevice(device.value(), transform.value());
+    if (!add_res) {
+      std::cout << "Failed to add device: " << add_res.error().message()
+                << std::endl;
+      return 1;
+    }
+
+    return set_control_points(control_points);
+  }
+
+  // Sets the control point count, with the device update rates adjusted to
+  // the maximum for it. Returns 0 on success, 1 after printing the reason.
+  int set_control_points(size_t count) {
+    auto cp_res = _emitter->setControlPointCount(count, AdjustRate::All);
+    if (!cp_res) {
+      std::cout << "Failed to setControlPointCount: "
+                << cp_res.error().message() << std::endl;
+      return 1;
+    }
+    auto rate_res = _emitter->getEmitterUpdateRate();
+    _point_rate = rate_res ? rate_res.value() : 0.f;
+    return 0;
+  }
+  // Update rate of each control point since the last set_control_points()
+  float point_rate() const { return _point_rate; }
+
+  StreamingEmitter& emitter() { return *_emitter; }
+
+  // Feeds listener with hand frames until unlisten() or the end of the
+  // runtime
+  void listen(HandTracking::LeapListening& listener) {
+    _hands.listen(listener);
+  }
+  void unlisten(HandTracking::LeapListening& listener) {
+    _hands.unlisten(listener);
+  }
+  // Waits up to timeout for listener to publish its first frame, e.g. before
+  // a configuration it feeds is staged: rendered before that, the hand is
+  // missing and the configuration plays silence. Returns false if no frame
+  // came, e.g. while the Leap is disconnected.
+  bool wait_for_frame(const HandTracking::LeapListening& listener,
+                      std::chrono::milliseconds timeout =
+                          std::chrono::milliseconds(200)) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (listener.frames() == 0) {
+      if (std::chrono::steady_clock::now() >= deadline) {
+        return false;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+  }
+
+  // Streams through callback with user_pointer. Only while the emitter is
+  // stopped. Returns 0 on success, 1 after printing the reason.
+  int set_callback(EmissionCallback callback, void* user_pointer) {
+    _instrumented.wrap(callback, user_pointer);
+    if (_callback_set) {
+      return 0;
+    }
+    auto ec_res = _emitter->setEmissionCallback(
+        Instrumentation::InstrumentedCallback::emitter_callback,
+        &_instrumented);
+    if (!ec_res) {
+      std::cout << "Failed to setEmissionCallback: "
+                << ec_res.error().message() << std::endl;
+      return 1;
+    }
+    _callback_set = true;
+    return 0;
+  }
+  // Interval timings of the callback
+  Instrumentation::CallbackStats& stats() { return _instrumented.stats; }
+
+  void start() {
+    _hands.start();
+    _emitter->start();
+    _running = true;
+  }
+  void stop() {
+    if (_running) {
+      _emitter->stop();
+      _hands.stop();
+      _running = false;
+    }
+  }
+  void pause() { _emitter->pause(); }
+  void resume() { _emitter->resume(); }
+
+ private:
+  Library _library;
+  std::unique_ptr<StreamingEmitter> _emitter;
+  HandTracking::HandStream _hands;
+  Instrumentation::InstrumentedCallback _instrumented;
+  float _point_rate = 0.f;
+  bool _callback_set = false;
+  bool _running = false;
+};
+}  // namespace RandomWalk::Streaming
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+#include <ultraleap/haptics/local_time.hpp>
+
+namespace RandomWalk::Time {
+
+// Maps emitter time points onto a 64-bit sample index. Periodic evaluation
+// works on the index instead of float seconds, so the phase stays exact for
+// sessions of any length.
+class SampleClock {
+ public:
+  explicit SampleClock(Ultraleap::Haptics::LocalTimePoint origin =
+                           Ultraleap::Haptics::LocalTimeClock::now())
+      : _origin(origin) {}
+
+  // Index of the sample at time on a clock ticking every period, as given by
+  // OutputInterval::iteratorTimeInterval()
+  int64_t index(const Ultraleap::Haptics::LocalTimePoint& time,
+                const Ultraleap::Haptics::LocalDuration& period) const {
+    int64_t ns = (time - _origin).count();
+    int64_t p = period.count() > 0 ? period.count() : 1;
+    return ns >= 0 ? (ns + p / 2) / p : -((p / 2 - ns) / p);
+  }
+  // Time of the sample at index on a clock ticking rate times per second
+  Ultraleap::Haptics::LocalTimePoint time(int64_t index, double rate) const {
+    return _origin + Ultraleap::Haptics::LocalDuration(
+                         std::llround(index * (1e9 / rate)));
+  }
+  // Samples per second of a clock ticking every period
+  static double rate(const Ultraleap::Haptics::LocalDuration& period) {
+    return period.count() > 0 ? 1e9 / period.count() : 0.0;
+  }
+  const Ultraleap::Haptics::LocalTimePoint& origin() const { return _origin; }
+
+ private:
+  Ultraleap::Haptics::LocalTimePoint _origin;
+};
+
+// Exact phase of a periodic signal on the sample clock. The cycles advanced
+// per sample are kept as the integer ratio step / modulus, so the phase at
+// any sample index is computed without accumulating rounding errors.
+class PhaseAccumulator {
+ public:
+  PhaseAccumulator(int64_t step = 0, int64_t modulus = 1)
+      : _step(step), _modulus(modulus > 0 ? modulus : 1) {}
+
+  // Signal of frequency Hz, resolved to millihertz
+  static PhaseAccumulator from_frequency(double frequency, double rate) {
+    return PhaseAccumulator(std::llround(frequency * 1000),
+                            std::llround(rate * 1000));
+  }
+  // Signal with a period of period_ms milliseconds, resolved to microseconds
+  static PhaseAccumulator from_period_ms(double period_ms, double rate) {
+    return PhaseAccumulator(1000000, std::llround(period_ms * 1000 * rate));
+  }
+
+  // Whole cycles completed at sample index
+  int64_t cycles(int64_t index) const {
+    return (index / _modulus) * _step + (index % _modulus) * _step / _modulus;
+  }
+  // Position the accumulator at sample index
+  void seek(int64_t index) { _value = (index % _modulus) * _step % _modulus; }
+  // Move to the next sample, returns the number of cycles completed. Only a
+  // completed cycle costs a division.
+  int64_t advance() {
+    _value += _step;
+    if (_value < _modulus) {
+      return 0;
+    }
+    int64_t completed = _value / _modulus;
+    _value -= completed * _modulus;
+    return completed;
+  }
+  // Fraction of the current cycle, in [0, 1)
+  double fraction() const { return (double)_value / _modulus; }
+  // Cycles advanced per sample
+  double step() const { return (double)_step / _modulus; }
+
+ private:
+  int64_t _step;
+  int64_t _modulus;
+  int64_t _value = 0;
+};
+
+}  // namespace RandomWalk::Time
@@ -0,0 +1,149 @@
+#include "Scheduler.hpp"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <timeapi.h>
+#pragma comment(lib, "winmm")
+#endif
+
+namespace RandomWalk::Time {
+Scheduler::Scheduler() {
+#ifdef _WIN32
+  // Sleeps otherwise end on the 15.6 ms system tick, far past the deadline
+  timeBeginPeriod(1);
+#endif
+  _thread = std::thread([this]() { run(); });
+}
+
+Scheduler::~Scheduler() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _wake.notify_one();
+  _thread.join();
+#ifdef _WIN32
+  timeEndPeriod(1);
+#endif
+}
+
+Scheduler::Handle Scheduler::at(Clock::time_point deadline,
+                                Task task,
+                                Handle handle) {
+  return schedule(deadline, Clock::duration::zero(), std::move(task),
+                  std::move(handle));
+}
+
+Scheduler::Handle Scheduler::setInterval(Task task,
+                                         Clock::duration interval,
+                                         Handle handle) {
+  interval = std::max(interval, Clock::duration(1));
+  return schedule(Clock::now() + interval, interval, std::move(task),
+                  std::move(handle));
+}
+
+Scheduler::Handle Scheduler::schedule(Clock::time_point deadline,
+                                      Clock::duration period,
+                                      Task task,
+                                      Handle handle) {
+  if (!handle._cancelled) {
+    handle._cancelled = std::make_shared<std::atomic<bool>>(false);
+  }
+  handle._scheduler = this;
+  bool earliest;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    push({deadline, period, _sequence++, std::move(task), handle._cancelled});
+    earliest = _entries.front().sequence == _sequence - 1;
+  }
+  // The thread may sleep past the new deadline
+  if (earliest) {
+    _wake.notify_one();
+  }
+  return handle;
+}
+
+void Scheduler::Handle::cancel() {
+  if (!_cancelled) {
+    return;
+  }
+  _cancelled->store(true);
+  if (_scheduler != nullptr) {
+    _scheduler->wait_for(_cancelled.get());
+  }
+}
+
+void Scheduler::wait_for(const std::atomic<bool>* cancelled) {
+  // A task cancelling itself would wait for itself
+  if (std::this_thread::get_id() == _thread.get_id()) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(_mutex);
+  _done.wait(lock, [&]() { return _running != cancelled; });
+}
+
+bool Scheduler::later(const Entry& a, const Entry& b) {
+  return a.deadline != b.deadline ? a.deadline > b.deadline
+                                  : a.sequence > b.sequence;
+}
+
+void Scheduler::push(Entry entry) {
+  _entries.push_back(std::move(entry));
+  std::push_heap(_entries.begin(), _entries.end(), later);
+}
+
+Scheduler::Entry Scheduler::pop() {
+  std::pop_heap(_entries.begin(), _entries.end(), later);
+  Entry entry = std::move(_entries.back());
+  _entries.pop_back();
+  return entry;
+}
+
+void Scheduler::run() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (!_stopping) {
+    if (_entries.empty()) {
+      _wake.wait(lock);
+      continue;
+    }
+    // Re-examined after every wait, an earlier task may have come in
+    const Clock::time_point deadline = _entries.front().deadline;
+    if (!_entries.front().cancelled->load() && Clock::now() < deadline) {
+      _wake.wait_until(lock, deadline);
+      continue;
+    }
+
+    // Checked under the mutex: a cancel() from here on sees the task as
+    // running and waits for it
+    Entry entry = pop();
+    if (entry.cancelled->load()) {
+      continue;
+    }
+    _running = entry.cancelled.get();
+    lock.unlock();
+    entry.task();
+    lock.lock();
+    _running = nullptr;
+    _done.notify_all();
+
+    if (entry.period > Clock::duration::zero() && !entry.cancelled->load()) {
+      entry.deadline += entry.period;
+      const Clock::time_point after = Clock::now();
+      if (entry.deadline <= after) {
+        entry.deadline +=
+            ((after - entry.deadline) / entry.period + 1) * entry.period;
+      }
+      entry.sequence = _sequence++;
+      push(std::move(entry));
+    }
+  }
+}
+}  // namespace RandomWalk::Time
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace RandomWalk::Time {
+
+// Runs timed tasks on one thread of its own, in the order of their deadlines.
+// Deadlines are absolute steady_clock times: a task that runs late does not
+// delay the ones after it, and a periodic task runs at first + k * period
+// without accumulating drift. The thread sleeps until the next deadline, on
+// Windows with the timer resolution raised to 1 ms while the scheduler exists.
+//
+// Tasks run one at a time and should be short, a long task delays the next
+// one. They may schedule and cancel tasks themselves.
+class Scheduler {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using Task = std::function<void()>;
+
+  // Cancels the tasks scheduled with it, copies share them. Empty until a
+  // task is scheduled with it.
+  class Handle {
+   public:
+    Handle() : _scheduler(nullptr) {}
+    // Tasks that have not started yet no longer run, and periodic ones stop.
+    // A task of the handle that is running is waited for, so none of them
+    // runs once cancel() returns. Safe from any thread while the scheduler
+    // exists, also from a task, which is not waited for then.
+    void cancel();
+    bool cancelled() const { return _cancelled && _cancelled->load(); }
+
+   private:
+    friend class Scheduler;
+    std::shared_ptr<std::atomic<bool>> _cancelled;
+    Scheduler* _scheduler;
+  };
+
+  Scheduler();
+  // Drops the pending tasks, after the running one returns
+  ~Scheduler();
+  Scheduler(const Scheduler&) = delete;
+  Scheduler& operator=(const Scheduler&) = delete;
+
+  // Runs task once at deadline. With the handle of earlier tasks, they are
+  // cancelled together.
+  Handle at(Clock::time_point deadline, Task task, Handle handle = Handle());
+  Handle setTimeout(Task task, Clock::duration delay,
+                    Handle handle = Handle()) {
+    return at(Clock::now() + delay, std::move(task), std::move(handle));
+  }
+  // Runs task every interval, from interval on. Runs missed by whole
+  // intervals, e.g. behind a long task, are skipped rather than made up.
+  Handle setInterval(Task task, Clock::duration interval,
+                     Handle handle = Handle());
+
+  // A handle no task is scheduled with yet, for tasks that need the handle
+  // they are scheduled with, e.g. to schedule themselves again with it
+  Handle handle() {
+    Handle handle;
+    handle._cancelled = std::make_shared<std::atomic<bool>>(false);
+    handle._scheduler = this;
+    return handle;
+  }
+
+  // A duration of ms milliseconds, to the resolution of the clock
+  static Clock::duration from_ms(double ms) {
+    return std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double, std::milli>(ms));
+  }
+
+ private:
+  struct Entry {
+    Clock::time_point deadline;
+    // Zero for tasks that run once
+    Clock::duration period;
+    // Orders entries with equal deadlines as they were scheduled
+    uint64_t sequence;
+    Task task;
+    std::shared_ptr<std::atomic<bool>> cancelled;
+  };
+  // Min-heap on the deadline, see later()
+  std::vector<Entry> _entries;
+  uint64_t _sequence = 0;
+  bool _stopping = false;
+  // The cancelled flag of the task running, nullptr between tasks
+  const std::atomic<bool>* _running = nullptr;
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  // Notified when a task returns
+  std::condition_variable _done;
+  std::thread _thread;
+
+  Handle schedule(Clock::time_point deadline, Clock::duration period,
+                  Task task, Handle handle);
+  // Later entries sort first, making the std heap a min-heap
+  static bool later(const Entry& a, const Entry& b);
+  // Waits until no task with the cancelled flag runs, unless called from one
+  void wait_for(const std::atomic<bool>* cancelled);
+  // With the mutex held
+  void push(Entry entry);
+  Entry pop();
+  void run();
+};
+}  // namespace RandomWalk::Time
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ultraleap/haptics/sensations.hpp"
+
+#include "SensationTrials.hpp"
+#include "Utils.hpp"
+
+namespace RandomWalk::Sensations {
+
+// Parameters of a trial that control how it is played rather than the
+// sensation. They are set on the sensation instance if its sensation gates
+// itself by them, see gates_itself(), and left out otherwise.
+inline bool is_trial_control(const std::string& name) {
+  return name == "duration" || name == "meta_frequency";
+}
+
+// True if the sensation of instance applies the meta_frequency gating of its
+// trials to its intensity at the sample clock, as the RW.* sensations of
+// NonStandardSensations do. Sensations of packages built before that are
+// gated by pausing the emitter instead.
+inline bool gates_itself(
+    const Ultraleap::Haptics::SensationInstance& instance) {
+  return bool(instance.sensation().getParameter("meta_frequency"));
+}
+
+// One SensationInstance per sensation id of a session, built when the trials
+// are loaded. The parameters of the trials are resolved to the arguments of
+// their sensation up front, so switching to a trial patches the arguments of
+// a ready instance in O(parameters), and only those that change. Arguments a
+// trial does not give are reset to their defaults, as on a fresh instance.
+//
+// The instances are reused across trials: the one returned by apply() is the
+// one of every trial of that sensation. Nothing may change it from another
+// thread during apply(), e.g. set the hand on it.
+class SensationPool {
+ public:
+  using SensationInstance = Ultraleap::Haptics::SensationInstance;
+
+  // Builds the instances of the sensations of trials and of extra, e.g. a
+  // training sensation played outside the trials. trials must outlive the
+  // pool. Returns 0 on success and 1 after printing the reason if a sensation
+  // is not in package. Parameters the sensation does not have are reported
+  // and ignored, and so are trials with a meta_frequency for a sensation that
+  // does not gate itself, e.g. from a package built before gatedIntensity.
+  int load(const Ultraleap::Haptics::SensationPackage& package,
+           const SensationTrials& trials,
+           const std::vector<sensation>& extra = {}) {
+    _trials = &trials;
+    for (const SensationGrid& grid : trials.grids()) {
+      std::vector<std::string> names;
+      for (const ParameterAxis& axis : grid.axes) {
+        names.push_back(axis.name);
+      }
+      if (!resolve(package, grid.id, names, _grids.emplace_back())) {
+        return 1;
+      }
+    }
+    for (const sensation& trial : extra) {
+      GridArguments unused;
+      if (!resolve(package, std::get<1>(trial),
+                   Utils::map_get_keys(std::get<2>(trial)), unused)) {
+        return 1;
+      }
+    }
+    return 0;
+  }
+
+  // The instance of the sensation of the trial at index, with the arguments
+  // of the trial
+  SensationInstance& apply(size_t index) {
+    const GridArguments& grid = _grids[_trials->decode(index, _values)];
+    Slot& slot = *_slots[grid.slot];
+    reset(slot);
+    for (size_t axis = 0; axis < grid.arguments.size(); axis++) {
+      if (grid.arguments[axis] >= 0) {
+        _targets[grid.arguments[axis]] = _values[axis];
+      }
+    }
+    return patch(slot);
+  }
+  // The instance of a sensation given to load(), with its arguments. Looks
+  // the parameters up by name.
+  SensationInstance& apply(const sensation& trial) {
+    Slot& slot = *_slots[_by_id.at(std::get<1>(trial))];
+    reset(slot);
+    for (const auto& parameter : std::get<2>(trial)) {
+      auto argument = slot.by_name.find(parameter.first);
+      if (argument != slot.by_name.end()) {
+        _targets[argument->second] = parameter.second;
+      }
+    }
+    return patch(slot);
+  }
+
+  // Number of instances
+  size_t size() const { return _slots.size(); }
+
+ private:
+  struct Argument {
+    std::string path;
+    float default_value;
+    // As last set on the instance, NaN before
+    float value = std::numeric_limits<float>::quiet_NaN();
+  };
+  struct Slot {
+    explicit Slot(SensationInstance instance) : instance(std::move(instance)) {}
+
+    SensationInstance instance;
+    std::vector<Argument> arguments;
+    std::map<std::string, int> by_name;
+    // Whether a meta_frequency it does not gate by was reported
+    bool ungated_reported = false;
+  };
+  // The slot of a grid, and the argument of each of its axes, -1 for
+  // parameters the sensation does not have
+  struct GridArguments {
+    size_t slot = 0;
+    std::vector<int> arguments;
+  };
+
+  const SensationTrials* _trials = nullptr;
+  std::vector<std::unique_ptr<Slot>> _slots;
+  std::map<std::string, size_t> _by_id;
+  std::vector<GridArguments> _grids;
+  // Scratch space of apply()
+  std::vector<float> _values;
+  std::vector<float> _targets;
+
+  bool resolve(const Ultraleap::Haptics::SensationPackage& package,
+               const std::string& id,
+               const std::vector<std::string>& names,
+               GridArguments& grid) {
+    auto found = _by_id.find(id);
+    if (found == _by_id.end()) {
+      auto sensation = package.sensation(id);
+      if (!sensation) {
+        std::cout << "Unknown sensation: " << id << std::endl;
+        return false;
+      }
+      _slots.push_back(
+          std::make_unique<Slot>(SensationInstance(sensation.value())));
+      found = _by_id.insert({id, _slots.size() - 1}).first;
+    }
+    grid.slot = found->second;
+    Slot& slot = *_slots[grid.slot];
+
+    for (const std::string& name : names) {
+      int argument = -1;
+      auto known = slot.by_name.find(name);
+      if (known != slot.by_name.end()) {
+        argument = known->second;
+      } else {
+        auto parameter = slot.instance.sensation().getParameter(name);
+        // Without a default the argument could not be reset after a trial
+        auto default_value = slot.instance.get(name);
+        if (parameter && !default_value) {
+          std::cout << "Ignoring parameter " << name << " of " << id
+                    << ", it has no default" << std::endl;
+        } else if (parameter) {
+          argument = (int)slot.arguments.size();
+          slot.arguments.push_back(
+              {parameter.value().path(), default_value.value()});
+          slot.by_name.insert({name, argument});
+        } else if (name == "meta_frequency") {
+          if (!slot.ungated_reported) {
+            std::cout << "Warning: " << id << " does not gate itself by "
+                      << "meta_frequency, its trials are gated by pausing "
+                      << "the emitter. Rebuild the sensation package to "
+                      << "gate at the sample clock." << std::endl;
+            slot.ungated_reported = true;
+          }
+        } else if (!is_trial_control(name)) {
+          std::cout << "Ignoring parameter " << name << ", not one of "
+                    << id << std::endl;
+        }
+      }
+      grid.arguments.push_back(argument);
+    }
+    _targets.resize(std::max(_targets.size(), slot.arguments.size()));
+    return true;
+  }
+
+  void reset(const Slot& slot) {
+    for (size_t i = 0; i < slot.arguments.size(); i++) {
+      _targets[i] = slot.arguments[i].default_value;
+    }
+  }
+  // Sets the arguments of slot that differ from _targets
+  SensationInstance& patch(Slot& slot) {
+    for (size_t i = 0; i < slot.arguments.size(); i++) {
+      Argument& argument = slot.arguments[i];
+      const float target = _targets[i];
+      if (target == argument.value) {
+        continue;
+      }
+      if (slot.instance.set(argument.path, target)) {
+        argument.value = target;
+      }
+    }
+    return slot.instance;
+  }
+};
+}  // namespace RandomWalk::Sensations
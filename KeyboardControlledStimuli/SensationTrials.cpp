@@ -0,0 +1,182 @@
+#include "SensationTrials.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "Utils.hpp"
+#include "json.hpp"
+
+using json = nlohmann::json;
+
+namespace RandomWalk::Sensations {
+size_t SensationGrid::size() const {
+  size_t size = 1;
+  for (const ParameterAxis& axis : axes) {
+    size *= axis.values.size();
+  }
+  return size;
+}
+
+void SensationTrials::add(SensationGrid grid) {
+  size_t size = grid.size();
+  if (size == 0) {
+    return;
+  }
+  _first.push_back(_size);
+  _grids.push_back(std::move(grid));
+  _size += size;
+}
+
+size_t SensationTrials::decode(size_t index, std::vector<float>& values) const {
+  // The last grid starting at or before index
+  size_t grid =
+      std::upper_bound(_first.begin(), _first.end(), index) - _first.begin() - 1;
+  index -= _first[grid];
+  const std::vector<ParameterAxis>& axes = _grids[grid].axes;
+  values.resize(axes.size());
+  // Digits from the last axis, which counts fastest
+  for (size_t i = axes.size(); i-- > 0;) {
+    values[i] = axes[i].values[index % axes[i].values.size()];
+    index /= axes[i].values.size();
+  }
+  return grid;
+}
+
+sensation SensationTrials::trial(size_t index) const {
+  std::vector<float> values;
+  const SensationGrid& grid = _grids[decode(index, values)];
+  parameters params;
+  for (size_t i = 0; i < grid.axes.size(); i++) {
+    params.insert({grid.axes[i].name, values[i]});
+  }
+  return {grid.name, grid.id, params};
+}
+
+std::string SensationTrials::key(size_t index) const {
+  std::vector<float> values;
+  const SensationGrid& grid = _grids[decode(index, values)];
+  std::stringstream stream;
+  stream << grid.name << "_" << grid.id << std::fixed << std::setprecision(3);
+  for (size_t i = 0; i < grid.axes.size(); i++) {
+    stream << "_" << grid.axes[i].name.substr(0, 2) << values[i];
+  }
+  return stream.str();
+}
+
+int parse_sensation_config(const std::string& path, SensationTrials& trials) {
+  json jsensations;
+  try {
+    std::ifstream fj(path);
+    try {
+      fj >> jsensations;
+    } catch (const std::exception&) {
+      std::cerr << "Failed to parse sensations JSON" << std::endl;
+      return 1;
+    }
+  } catch (const std::exception&) {
+    std::cerr << "Failed to load sensations JSON" << std::endl;
+    return 1;
+  }
+
+  std::string sensations_key = "sensations";
+  std::string shared_params_key = "shared_params";
+  std::string sensation_key = "sensation";
+  std::string sensation_name_key = "name";
+  std::string sensation_shared_params_key = "shared_params";
+  std::string sensation_params_key = "params";
+
+  std::map<std::tuple<std::string, std::string>, sensation_values> iterators;
+  if (jsensations.contains(sensations_key)) {
+    for (auto& jsensation : jsensations[sensations_key]) {
+      parameters parameters;
+
+      std::string sensation_id = jsensation[sensation_key];
+      Utils::replace(sensation_id, "\"", "");
+
+      std::string sensation_name = sensation_id;
+      if (jsensation.contains(sensation_name_key)) {
+        sensation_name = jsensation[sensation_name_key];
+        Utils::replace(sensation_name, "\"", "");
+      }
+
+      std::tuple<std::string, std::string> id = {sensation_name, sensation_id};
+
+      // insert shared parameters
+      if (jsensation.contains(sensation_shared_params_key)) {
+        auto curr_sensation_it = iterators.find(id);
+        sensation_values curr_sensation = {};
+        if (curr_sensation_it != iterators.end()) {
+          curr_sensation = curr_sensation_it->second;
+        }
+
+        auto o = jsensation[sensation_shared_params_key];
+        for (json::iterator it = o.begin(); it != o.end(); ++it) {
+          if (jsensations[shared_params_key].contains(it.key())) {
+            auto value = it.value().dump();
+            if (it.value().is_string()) {
+              Utils::replace(value, "\"", "");
+            } else {
+              continue;
+            }
+            auto curr_param_it = curr_sensation.find(value);
+            sensation_value curr_params;
+            if (curr_param_it != curr_sensation.end()) {
+              curr_params = curr_param_it->second;
+            }
+
+            auto values = jsensations[shared_params_key][it.key()];
+            curr_params.insert(curr_params.end(), values.begin(), values.end());
+            curr_sensation.insert({value, curr_params});
+          }
+        }
+        iterators[id] = curr_sensation;
+      }
+
+      if (jsensation.contains(sensation_params_key)) {
+        auto curr_sensation_it = iterators.find(id);
+        sensation_values curr_sensation;
+        if (curr_sensation_it != iterators.end()) {
+          curr_sensation = curr_sensation_it->second;
+        }
+
+        auto o = jsensation[sensation_params_key];
+        for (json::iterator it = o.begin(); it != o.end(); ++it) {
+          sensation_value curr_params;
+          auto curr_param_it = curr_sensation.find(it.key());
+          if (curr_param_it != curr_sensation.end()) {
+            curr_params = curr_param_it->second;
+          }
+
+          auto values = it.value();
+          if (!values.is_array()) {
+            values = std::vector<float>{values};
+          }
+
+          curr_params.insert(curr_params.end(), values.begin(), values.end());
+          curr_sensation.insert({it.key(), curr_params});
+        }
+        iterators[id] = curr_sensation;
+      }
+
+      if (!jsensation.contains(sensation_shared_params_key) &&
+          !jsensation.contains(sensation_params_key)) {
+        iterators[id] = {};
+      }
+    }
+
+    for (auto& sensation : iterators) {
+      SensationGrid grid;
+      grid.name = std::get<0>(sensation.first);
+      grid.id = std::get<1>(sensation.first);
+      for (auto& values : sensation.second) {
+        grid.axes.push_back({values.first, values.second});
+      }
+      trials.add(std::move(grid));
+    }
+  }
+  return 0;
+}
+}  // namespace RandomWalk::Sensations
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace RandomWalk::Sensations {
+
+// #0 parameter name, #1 parameter value
+typedef std::map<std::string, float> parameters;
+// #0 sensation name, #1 sensation key, #2 parameters
+typedef std::tuple<std::string, std::string, parameters> sensation;
+// #0 sensation identifier, #1 sensation
+typedef std::map<std::string, sensation> sensations;
+typedef std::vector<float> sensation_value;
+// #0 sensation name, #1 sensation key
+typedef std::map<std::string, sensation_value> sensation_values;
+
+// The values one parameter of a sensation takes over its trials
+struct ParameterAxis {
+  std::string name;
+  std::vector<float> values;
+};
+
+// One sensation of a configuration, with a trial for every combination of
+// the values of its axes
+struct SensationGrid {
+  std::string name;
+  std::string id;
+  // By parameter name
+  std::vector<ParameterAxis> axes;
+
+  // The product of the numbers of values, 1 without axes
+  size_t size() const;
+};
+
+// The trials of a sensation configuration, decoded from their index on
+// demand instead of expanded up front. Only the values of each axis are held,
+// so memory grows with the axes rather than with the trials, and any trial is
+// decoded in O(axes).
+//
+// The trials of the grids follow each other in the order they were added.
+// Within a grid the index is a mixed radix number with one digit per axis,
+// the last axis counting fastest. A shuffled order is a permutation of the
+// indices, e.g. drawn by Utils::TrialSampler.
+class SensationTrials {
+ public:
+  // Grids without trials, i.e. with an axis without values, are left out
+  void add(SensationGrid grid);
+
+  size_t size() const { return _size; }
+  bool empty() const { return _size == 0; }
+  const std::vector<SensationGrid>& grids() const { return _grids; }
+
+  // The trial at index, index < size()
+  sensation trial(size_t index) const;
+  // Decodes the trial at index into the value of each axis of its grid, in
+  // the order of the axes, and returns the index of the grid. Allocates
+  // nothing once values has room for the axes.
+  size_t decode(size_t index, std::vector<float>& values) const;
+  // The identifier of the trial at index, the sensation name and id followed
+  // by the first two letters and the value of each parameter, e.g.
+  // "Point_RW.AmplitudeModulatedPoint_du4000.000_fr125.000"
+  std::string key(size_t index) const;
+
+ private:
+  std::vector<SensationGrid> _grids;
+  // Index of the first trial of each grid
+  std::vector<size_t> _first;
+  size_t _size = 0;
+};
+
+// Reads a sensation configuration (SensationConfigs/*.json) into trials, one
+// grid per sensation. Returns 0 on success and 1 if the file could not be
+// loaded or parsed.
+int parse_sensation_config(const std::string& path, SensationTrials& trials);
+}  // namespace RandomWalk::Sensations
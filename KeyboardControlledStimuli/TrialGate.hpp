@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <utility>
+
+#include "Scheduler.hpp"
+#include "SensationTrials.hpp"
+
+namespace RandomWalk::Sensations {
+
+// The meta_frequency gating of a trial, as the RW.* sensations apply it to
+// their intensity at every sample (gatedIntensity in RenderIntensity.ele):
+// duration split into meta_frequency windows of equal length, on and off in
+// turns starting on, and off from the end of duration. Times are ms of
+// sensation time, counted from the start of the trial.
+struct TrialGate {
+  double duration = 0;
+  // 0 keeps the trial on for the whole duration
+  double meta_frequency = 0;
+
+  // The gate of a trial, with default_duration if it does not give one
+  static TrialGate of(const parameters& params, double default_duration = 0) {
+    TrialGate gate;
+    auto duration_it = params.find("duration");
+    gate.duration =
+        duration_it != params.end() ? duration_it->second : default_duration;
+    auto meta_frequency_it = params.find("meta_frequency");
+    if (meta_frequency_it != params.end()) {
+      gate.meta_frequency = std::max(0.f, meta_frequency_it->second);
+    }
+    return gate;
+  }
+
+  double window() const {
+    return meta_frequency > 0 ? duration / meta_frequency : duration;
+  }
+  // The number of windows, the last one is cut short if meta_frequency is not
+  // whole
+  size_t windows() const {
+    if (duration <= 0) {
+      return 0;
+    }
+    return meta_frequency > 0 ? (size_t)std::ceil(meta_frequency) : 1;
+  }
+  size_t on_windows() const { return (windows() + 1) / 2; }
+  // The start and end of on window i, i < on_windows()
+  std::pair<double, double> on_window(size_t i) const {
+    double start = 2 * i * window();
+    return {start, std::min(start + window(), duration)};
+  }
+  bool on(double time) const {
+    return time >= 0 && time < duration &&
+           (size_t)std::floor(time / window()) % 2 == 0;
+  }
+};
+
+namespace detail {
+// Ends the trial if the sensation time reached the end of gate, or checks
+// again with handle for when it should have. Without a sensation time the
+// trial ends at deadline.
+template <typename Emitter>
+void check_trial_end(Time::Scheduler& scheduler,
+                     Emitter& emitter,
+                     const TrialGate& gate,
+                     const std::function<void()>& finished,
+                     Time::Scheduler::Clock::time_point deadline,
+                     const Time::Scheduler::Handle& handle) {
+  auto time = emitter.getCurrentSensationTime();
+  const Time::Scheduler::Clock::duration remaining =
+      time ? Time::Scheduler::from_ms(gate.duration - time.value() * 1000)
+           : deadline - Time::Scheduler::Clock::now();
+  if (remaining <= Time::Scheduler::Clock::duration::zero()) {
+    finished();
+    return;
+  }
+  scheduler.setTimeout(
+      [&scheduler, &emitter, gate, finished, deadline, handle]() {
+        check_trial_end(scheduler, emitter, gate, finished, deadline, handle);
+      },
+      remaining, handle);
+}
+}  // namespace detail
+
+// Calls finished on scheduler once the sensation time of emitter reaches the
+// end of gate, unless the returned handle is cancelled first, e.g. when the
+// next trial is set. The sensation time is the clock the emitter samples the
+// sensation at, restarted by setSensation, so the end follows the samples the
+// gate closed at: the check is scheduled for when the clock should get there,
+// and again for the remainder if it has not. Every check is scheduled with the
+// returned handle. If the emitter cannot tell the sensation time, the trial
+// ends gate.duration after the call on the steady clock.
+template <typename Emitter>
+Time::Scheduler::Handle on_trial_end(Time::Scheduler& scheduler,
+                                     Emitter& emitter,
+                                     const TrialGate& gate,
+                                     std::function<void()> finished) {
+  Time::Scheduler::Handle handle = scheduler.handle();
+  detail::check_trial_end(
+      scheduler, emitter, gate, finished,
+      Time::Scheduler::Clock::now() + Time::Scheduler::from_ms(gate.duration),
+      handle);
+  return handle;
+}
+}  // namespace RandomWalk::Sensations
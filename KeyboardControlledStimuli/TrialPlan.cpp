@@ -0,0 +1,333 @@
+#include "TrialPlan.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "TrialSampler.hpp"
+
+namespace RandomWalk::Sensations {
+namespace {
+static_assert(sizeof(PlanHeader) == 80, "Trial plan header layout changed");
+
+const PlanHeader expected_header;
+
+// Sections start 8 byte aligned
+uint64_t align(uint64_t offset) {
+  return (offset + 7) & ~uint64_t(7);
+}
+
+// True if the file starts like a trial plan
+bool is_plan(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  char magic[4] = {};
+  file.read(magic, 4);
+  return file && std::memcmp(magic, expected_header.magic, 4) == 0;
+}
+
+template <typename T>
+void append(std::vector<char>& buffer, const T* data, size_t count) {
+  const char* bytes = reinterpret_cast<const char*>(data);
+  buffer.insert(buffer.end(), bytes, bytes + count * sizeof(T));
+}
+}  // namespace
+
+int TrialPlan::open(const std::string& path) {
+  close();
+  if (!is_plan(path)) {
+    return parse_sensation_config(path, _trials);
+  }
+
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+  LARGE_INTEGER size;
+  if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size)) {
+    if (file != INVALID_HANDLE_VALUE) {
+      CloseHandle(file);
+    }
+    std::cout << "Failed to open trial plan: " << path << std::endl;
+    return 1;
+  }
+  _file = file;
+  _size = (size_t)size.QuadPart;
+  _mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (_mapping != nullptr) {
+    _data = static_cast<const char*>(
+        MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+  }
+#else
+  int file = ::open(path.c_str(), O_RDONLY);
+  struct stat status;
+  if (file < 0 || fstat(file, &status) != 0) {
+    if (file >= 0) {
+      ::close(file);
+    }
+    std::cout << "Failed to open trial plan: " << path << std::endl;
+    return 1;
+  }
+  _size = (size_t)status.st_size;
+  void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, file, 0);
+  // The mapping holds on to the file
+  ::close(file);
+  if (data != MAP_FAILED) {
+    _data = static_cast<const char*>(data);
+  }
+#endif
+  if (_data == nullptr) {
+    close();
+    std::cout << "Failed to map trial plan: " << path << std::endl;
+    return 1;
+  }
+  if (!load()) {
+    close();
+    std::cout << "Invalid trial plan: " << path << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+void TrialPlan::close() {
+#ifdef _WIN32
+  if (_data != nullptr) {
+    UnmapViewOfFile(_data);
+  }
+  if (_mapping != nullptr) {
+    CloseHandle(_mapping);
+  }
+  if (_file != nullptr) {
+    CloseHandle(_file);
+  }
+#else
+  if (_data != nullptr) {
+    munmap(const_cast<char*>(_data), _size);
+  }
+#endif
+  _data = nullptr;
+  _size = 0;
+  _file = nullptr;
+  _mapping = nullptr;
+  _trials = SensationTrials();
+}
+
+bool TrialPlan::load() {
+  if (_size < sizeof(PlanHeader)) {
+    return false;
+  }
+  const PlanHeader& plan = header();
+  if (plan.version != expected_header.version) {
+    return false;
+  }
+  // count elements of size at offset lie within the file
+  auto within = [&](uint64_t offset, uint64_t count, size_t size) {
+    return offset % 8 == 0 && offset <= _size &&
+           count <= (_size - offset) / size;
+  };
+  if (!within(plan.strings, plan.string_count, sizeof(PlanString)) ||
+      !within(plan.grids, plan.grid_count, sizeof(PlanGrid)) ||
+      !within(plan.axes, plan.axis_count, sizeof(PlanAxis)) ||
+      !within(plan.values, plan.value_count, sizeof(float)) ||
+      !within(plan.schedules, plan.schedule_count, sizeof(PlanSchedule))) {
+    return false;
+  }
+
+  const PlanString* strings =
+      reinterpret_cast<const PlanString*>(_data + plan.strings);
+  const uint64_t characters =
+      plan.strings + plan.string_count * sizeof(PlanString);
+  for (uint32_t i = 0; i < plan.string_count; i++) {
+    if ((uint64_t)strings[i].offset + strings[i].length > _size - characters) {
+      return false;
+    }
+  }
+  auto string = [&](uint32_t index) {
+    return std::string(_data + characters + strings[index].offset,
+                       strings[index].length);
+  };
+
+  const PlanGrid* grids = reinterpret_cast<const PlanGrid*>(_data + plan.grids);
+  const PlanAxis* axes = reinterpret_cast<const PlanAxis*>(_data + plan.axes);
+  const float* values = reinterpret_cast<const float*>(_data + plan.values);
+  for (uint32_t g = 0; g < plan.grid_count; g++) {
+    const PlanGrid& grid = grids[g];
+    if (grid.name >= plan.string_count || grid.id >= plan.string_count ||
+        (uint64_t)grid.first_axis + grid.axis_count > plan.axis_count) {
+      return false;
+    }
+    SensationGrid decoded;
+    decoded.name = string(grid.name);
+    decoded.id = string(grid.id);
+    for (uint32_t a = grid.first_axis; a < grid.first_axis + grid.axis_count;
+         a++) {
+      const PlanAxis& axis = axes[a];
+      if (axis.name >= plan.string_count ||
+          (uint64_t)axis.first_value + axis.value_count > plan.value_count) {
+        return false;
+      }
+      decoded.axes.push_back(
+          {string(axis.name),
+           std::vector<float>(values + axis.first_value,
+                              values + axis.first_value + axis.value_count)});
+    }
+    _trials.add(std::move(decoded));
+  }
+  if (_trials.size() != plan.trial_count) {
+    return false;
+  }
+
+  for (uint32_t s = 0; s < plan.schedule_count; s++) {
+    if (!within(schedules()[s].order, plan.trial_count, sizeof(uint32_t))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::vector<size_t> TrialPlan::order(uint64_t seed) const {
+  std::vector<size_t> order(_trials.size());
+  if (compiled()) {
+    for (uint32_t s = 0; s < header().schedule_count; s++) {
+      const PlanSchedule& schedule = schedules()[s];
+      if (schedule.seed != seed) {
+        continue;
+      }
+      const uint32_t* indices =
+          reinterpret_cast<const uint32_t*>(_data + schedule.order);
+      bool valid = true;
+      for (size_t i = 0; i < order.size(); i++) {
+        order[i] = indices[i];
+        valid = valid && indices[i] < order.size();
+      }
+      if (valid) {
+        return order;
+      }
+      std::cout << "Invalid trial order for seed " << seed
+                << " in the trial plan, shuffling" << std::endl;
+      break;
+    }
+  }
+  Utils::TrialSampler sampler(order.size(), seed);
+  for (size_t& index : order) {
+    index = sampler.next();
+  }
+  return order;
+}
+
+std::vector<uint64_t> TrialPlan::seeds() const {
+  std::vector<uint64_t> seeds;
+  if (compiled()) {
+    for (uint32_t s = 0; s < header().schedule_count; s++) {
+      seeds.push_back(schedules()[s].seed);
+    }
+  }
+  return seeds;
+}
+
+int compile_trial_plan(const SensationTrials& trials,
+                       const std::vector<uint64_t>& seeds,
+                       const std::string& path) {
+  if (trials.size() > std::numeric_limits<uint32_t>::max()) {
+    std::cout << "Too many trials for a trial plan: " << trials.size()
+              << std::endl;
+    return 1;
+  }
+
+  // Intern the names, each is stored once
+  std::map<std::string, uint32_t> interned;
+  std::vector<PlanString> strings;
+  std::string characters;
+  auto intern = [&](const std::string& name) {
+    auto it = interned.find(name);
+    if (it != interned.end()) {
+      return it->second;
+    }
+    uint32_t index = (uint32_t)strings.size();
+    strings.push_back({(uint32_t)characters.size(), (uint32_t)name.size()});
+    characters += name;
+    interned.insert({name, index});
+    return index;
+  };
+
+  std::vector<PlanGrid> grids;
+  std::vector<PlanAxis> axes;
+  std::vector<float> values;
+  for (const SensationGrid& grid : trials.grids()) {
+    grids.push_back({intern(grid.name), intern(grid.id),
+                     (uint32_t)axes.size(), (uint32_t)grid.axes.size()});
+    for (const ParameterAxis& axis : grid.axes) {
+      axes.push_back({intern(axis.name), (uint32_t)values.size(),
+                      (uint32_t)axis.values.size(), 0});
+      values.insert(values.end(), axis.values.begin(), axis.values.end());
+    }
+  }
+
+  PlanHeader header;
+  header.trial_count = trials.size();
+  header.string_count = (uint32_t)strings.size();
+  header.grid_count = (uint32_t)grids.size();
+  header.axis_count = (uint32_t)axes.size();
+  header.value_count = (uint32_t)values.size();
+  header.schedule_count = (uint32_t)seeds.size();
+  header.strings = align(sizeof(PlanHeader));
+  header.grids = align(header.strings + strings.size() * sizeof(PlanString) +
+                       characters.size());
+  header.axes = align(header.grids + grids.size() * sizeof(PlanGrid));
+  header.values = align(header.axes + axes.size() * sizeof(PlanAxis));
+  header.schedules = align(header.values + values.size() * sizeof(float));
+  uint64_t order = align(header.schedules + seeds.size() * sizeof(PlanSchedule));
+  std::vector<PlanSchedule> schedules;
+  for (uint64_t seed : seeds) {
+    schedules.push_back({seed, order});
+    order = align(order + trials.size() * sizeof(uint32_t));
+  }
+
+  std::vector<char> buffer;
+  auto pad = [&](uint64_t offset) { buffer.resize(offset, 0); };
+  append(buffer, &header, 1);
+  pad(header.strings);
+  append(buffer, strings.data(), strings.size());
+  append(buffer, characters.data(), characters.size());
+  pad(header.grids);
+  append(buffer, grids.data(), grids.size());
+  pad(header.axes);
+  append(buffer, axes.data(), axes.size());
+  pad(header.values);
+  append(buffer, values.data(), values.size());
+  pad(header.schedules);
+  append(buffer, schedules.data(), schedules.size());
+  std::vector<uint32_t> indices(trials.size());
+  for (const PlanSchedule& schedule : schedules) {
+    Utils::TrialSampler sampler(trials.size(), schedule.seed);
+    for (uint32_t& index : indices) {
+      index = (uint32_t)sampler.next();
+    }
+    pad(schedule.order);
+    append(buffer, indices.data(), indices.size());
+  }
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file.write(buffer.data(), buffer.size())) {
+    std::cout << "Failed to write trial plan: " << path << std::endl;
+    return 1;
+  }
+  return 0;
+}
+}  // namespace RandomWalk::Sensations
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "SensationTrials.hpp"
+
+namespace RandomWalk::Sensations {
+
+// A trial plan is a sensation configuration compiled ahead of a session: the
+// grids of its trials and a pre-shuffled trial order for each of a set of
+// seeds, laid out to be mapped into memory as is. Loading it reads no JSON
+// and expands nothing, the orders are read straight from the mapping.
+//
+// The file is the PlanHeader followed by its sections at the offsets it
+// gives, 8 byte aligned, little-endian:
+//   strings    PlanString[string_count], the interned sensation names, ids
+//              and parameter names, their characters follow the array
+//   grids      PlanGrid[grid_count], one per sensation
+//   axes       PlanAxis[axis_count], the axes of the grids back to back
+//   values     float[value_count], the values of the axes back to back
+//   schedules  PlanSchedule[schedule_count], each pointing at trial_count
+//              uint32_t trial indices
+struct PlanHeader {
+  char magic[4] = {'R', 'W', 'T', 'P'};
+  // 2 since the orders are the portable TrialSampler shuffle
+  uint32_t version = 2;
+  uint64_t trial_count = 0;
+  uint32_t string_count = 0;
+  uint32_t grid_count = 0;
+  uint32_t axis_count = 0;
+  uint32_t value_count = 0;
+  uint32_t schedule_count = 0;
+  uint32_t reserved = 0;
+  uint64_t strings = 0;
+  uint64_t grids = 0;
+  uint64_t axes = 0;
+  uint64_t values = 0;
+  uint64_t schedules = 0;
+};
+struct PlanString {
+  // From the end of the PlanString array
+  uint32_t offset;
+  uint32_t length;
+};
+struct PlanGrid {
+  uint32_t name;
+  uint32_t id;
+  uint32_t first_axis;
+  uint32_t axis_count;
+};
+struct PlanAxis {
+  uint32_t name;
+  uint32_t first_value;
+  uint32_t value_count;
+  uint32_t reserved;
+};
+struct PlanSchedule {
+  uint64_t seed;
+  // Of the uint32_t trial indices, from the start of the file
+  uint64_t order;
+};
+
+// The trials of a session, from a trial plan or a sensation configuration
+class TrialPlan {
+ public:
+  TrialPlan() = default;
+  ~TrialPlan() { close(); }
+  TrialPlan(const TrialPlan&) = delete;
+  TrialPlan& operator=(const TrialPlan&) = delete;
+
+  // Maps the trial plan at path, or parses it as a sensation configuration if
+  // it is not a plan. Returns 0 on success and 1 after printing the reason.
+  int open(const std::string& path);
+  void close();
+  // True if the trials come from a compiled plan
+  bool compiled() const { return _data != nullptr; }
+
+  const SensationTrials& trials() const { return _trials; }
+  // The trial order of the first round of a session with seed, the order
+  // Utils::TrialSampler draws for that seed. Read from the plan if it was
+  // compiled with the seed, shuffled otherwise.
+  std::vector<size_t> order(uint64_t seed) const;
+  // The seeds the plan was compiled with
+  std::vector<uint64_t> seeds() const;
+
+ private:
+  SensationTrials _trials;
+  const char* _data = nullptr;
+  size_t _size = 0;
+  // The mapping, a handle pair on Windows
+  void* _file = nullptr;
+  void* _mapping = nullptr;
+
+  const PlanHeader& header() const {
+    return *reinterpret_cast<const PlanHeader*>(_data);
+  }
+  const PlanSchedule* schedules() const {
+    return reinterpret_cast<const PlanSchedule*>(_data + header().schedules);
+  }
+  // Checks the sections lie within the file and decodes the grids
+  bool load();
+};
+
+// Writes the trials and the orders for seeds as a trial plan to path. Returns
+// 0 on success and 1 after printing the reason.
+int compile_trial_plan(const SensationTrials& trials,
+                       const std::vector<uint64_t>& seeds,
+                       const std::string& path);
+}  // namespace RandomWalk::Sensations
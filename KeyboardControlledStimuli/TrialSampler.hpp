@@ -0,0 +1,68 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace RandomWalk::Utils {
+
+// Draws trial indices in [0, size) without replacement. The indices are kept
+// as a shuffled permutation, next() hands out the following one and the
+// permutation is reshuffled once every index was drawn. The same seed
+// reproduces the same sequence of trials, also across standard libraries:
+// the shuffle is a Fisher-Yates shuffle of its own on the raw mt19937_64
+// output, which the standard fixes, rather than std::shuffle, whose
+// permutation is up to the implementation.
+class TrialSampler {
+ public:
+  explicit TrialSampler(size_t size, uint64_t seed = std::random_device{}())
+      : _seed(seed), _generator(seed), _indices(size) {
+    std::iota(_indices.begin(), _indices.end(), size_t(0));
+    shuffle();
+  }
+
+  size_t next() {
+    if (_position == _indices.size()) {
+      shuffle();
+      _position = 0;
+      _round++;
+    }
+    return _indices[_position++];
+  }
+  // True once every index of the current round was drawn
+  bool exhausted() const { return _position == _indices.size(); }
+
+  size_t size() const { return _indices.size(); }
+  // Number of indices drawn in the current round
+  size_t position() const { return _position; }
+  size_t round() const { return _round; }
+  uint64_t seed() const { return _seed; }
+
+ private:
+  uint64_t _seed;
+  std::mt19937_64 _generator;
+  std::vector<size_t> _indices;
+  size_t _position = 0;
+  size_t _round = 0;
+
+  // Uniform in [0, bound), rejecting the raw values of the last partial
+  // multiple of bound so that none is favoured
+  uint64_t draw(uint64_t bound) {
+    const uint64_t threshold = (0 - bound) % bound;
+    for (;;) {
+      uint64_t value = _generator();
+      if (value >= threshold) {
+        return value % bound;
+      }
+    }
+  }
+  void shuffle() {
+    for (size_t i = _indices.size(); i > 1; i--) {
+      std::swap(_indices[i - 1], _indices[(size_t)draw(i)]);
+    }
+  }
+};
+}  // namespace RandomWalk::Utils
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace RandomWalk::HandTracking {
+
+// Hands the latest value from one writing thread to one reading thread, e.g.
+// hand data from the Leap thread to the emitter callback. Both sides are
+// wait-free: the writer fills a back buffer and swaps it with the middle one,
+// the reader swaps the middle buffer with its front buffer if a newer value
+// was published since it last read. Neither side ever waits on the other, and
+// no lock is involved, unlike std::atomic<T> of a large T.
+template <typename T>
+class TripleBuffer {
+ public:
+  TripleBuffer() = default;
+  explicit TripleBuffer(const T& value) {
+    for (auto& buffer : _buffers) {
+      buffer = value;
+    }
+  }
+  TripleBuffer(const TripleBuffer&) = delete;
+  TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+  // Writer: the buffer to fill before publish(), it holds an older value
+  T& back() { return _buffers[_back]; }
+  // Writer: makes the back buffer the latest value
+  void publish() {
+    _back = _middle.exchange(_back | fresh, std::memory_order_acq_rel) & index;
+  }
+  void publish(const T& value) {
+    back() = value;
+    publish();
+  }
+
+  // Reader: the latest published value. The reference stays valid and
+  // unchanged until the next read().
+  const T& read() {
+    if (_middle.load(std::memory_order_relaxed) & fresh) {
+      _front = _middle.exchange(_front, std::memory_order_acq_rel) & index;
+    }
+    return _buffers[_front];
+  }
+
+ private:
+  static constexpr uint8_t index = 0x3;
+  // Set on the middle buffer when published and not read yet
+  static constexpr uint8_t fresh = 0x4;
+
+  T _buffers[3] = {};
+  // Index of the middle buffer with the fresh bit, swapped by both sides
+  alignas(64) std::atomic<uint8_t> _middle{1};
+  // Owned by the writer
+  alignas(64) uint8_t _back = 0;
+  // Owned by the reader
+  alignas(64) uint8_t _front = 2;
+};
+
+}  // namespace RandomWalk::HandTracking
@@ -1,5 +1,7 @@
 #include "Utils.hpp"
 
+#include <stdexcept>
+
 namespace RandomWalk::Utils {
 Ultrahaptics::Vector3 lerp(const Ultrahaptics::Vector3& A,
                            const Ultrahaptics::Vector3& B,
@@ -41,4 +43,16 @@ std::string random_string(size_t length) {
   return str;
 }
 
+std::optional<uint64_t> parse_seed(const std::string& text) {
+  // std::stoull alone would take a sign, spaces and trailing characters
+  if (text.empty() ||
+      text.find_first_not_of("0123456789") != std::string::npos) {
+    return std::nullopt;
+  }
+  try {
+    return std::stoull(text);
+  } catch (const std::out_of_range&) {
+    return std::nullopt;
+  }
+}
 }  // namespace RandomWalk::Utils
\ No newline at end of file
@@ -1,12 +1,15 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
 #include <functional>
 #include <future>
 #include <iostream>
 #include <iterator>
 #include <map>
+#include <optional>
 #include <random>
+#include <string>
 #include <vector>
 
 #include <ultraleap/haptics/vector3.hpp>
@@ -149,6 +152,22 @@ std::tuple<KType, VType> map_get_random(std::map<KType, VType> map,
   return std::make_tuple(r_key, map[r_key]);
 }
 
+// The std::rand generator of the MSVC runtime, seeded like std::srand: the
+// same seed gives the values std::rand gave there, on any toolchain and
+// without touching the global std::rand state
+class MsvcRand {
+ public:
+  explicit MsvcRand(unsigned int seed) : _state(seed) {}
+  // In [0, 32767]
+  int operator()() {
+    _state = _state * 214013u + 2531011u;
+    return (int)((_state >> 16) & 0x7fff);
+  }
+
+ private:
+  uint32_t _state;
+};
+
 constexpr unsigned int hash(const char* s, int off = 0) {
   return !s[off] ? 5381 : (hash(s, off + 1) * 33) ^ s[off];
 };
@@ -157,4 +176,7 @@ void replace(std::string& str, const std::string& from, const std::string& to);
 
 std::string random_string(size_t length);
 
+// The seed written in text as a decimal number, nothing if text is not one
+std::optional<uint64_t> parse_seed(const std::string& text);
+
 }  // namespace RandomWalk::Utils
\ No newline at end of file
@@ -0,0 +1,450 @@
+// Load test of the emission callbacks without a haptics device or a Leap
+// controller. Streams the random walk configurations through the same
+// ConfigurationSlot, LookAhead or Compositor callbacks as the streaming
+// entries, driven by the mock emitter at real time or faster, with a
+// synthetic hand or a looped hand recording in place of the Leap. Trials are
+// switched while the emitter runs, like in the random configurations entries,
+// and the callback timings are printed at the end.
+//
+// The Leap service is not needed, but the Leap SDK is: the configurations
+// hold Leap listeners, which are fed the hand frames here. On Linux build
+// with e.g.
+//   g++ -std=c++17 -O2 -I../Dependencies/Ultrahaptics3.0.0/include
+//       -I../Dependencies/Leap/include -I../KeyboardControlledStimuli
+//       LoadTest.cpp ../KeyboardControlledStimuli/{Configurations,
+//       HandTracking,Modulation,Utils}.cpp -lLeap -pthread
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../OfflineRenderer/HandSource.hpp"
+#include "Compositor.h"
+#include "ConfigurationSlot.h"
+#include "Configurations.h"
+#include "Engine.h"
+#include "HandRecording.hpp"
+#include "HandTracking.h"
+#include "Instrumentation.hpp"
+#include "LookAhead.h"
+#include "MockEmitter.hpp"
+#include "Parameters.h"
+#include "TrialSampler.hpp"
+
+using namespace RandomWalk;
+using Ultraleap::Haptics::LocalDuration;
+using Ultraleap::Haptics::LocalTimePoint;
+using Ultraleap::Haptics::duration_from_sec;
+using Ultraleap::Haptics::duration_to_sec;
+
+namespace RandomWalk::LoadTest {
+using Streaming::Mock::Emitter;
+using Streaming::Mock::Interval;
+
+struct Options {
+  std::string callback = "slot";
+  std::string hand = "sway";
+  std::string record;
+  double speed = 1.0;
+  double seconds = 10;
+  double trial_ms = 1000;
+  size_t control_points = 1;
+  float callback_rate = 1000.f;
+  std::optional<uint64_t> seed;
+};
+
+void print_usage() {
+  std::cout
+      << "Usage: LoadTest [options]\n"
+         "  --callback <slot|look-ahead|composite>\n"
+         "                         emission callback to drive (default slot)\n"
+         "  --speed <x>            emitter speed, 1 is real time and 0 as\n"
+         "                         fast as possible (default 1)\n"
+         "  --seconds <s>          emitter time to run for (default 10)\n"
+         "  --trial-ms <ms>        emitter time per trial (default 1000)\n"
+         "  --control-points <n>   control points of the composite callback\n"
+         "                         (default 1)\n"
+         "  --callback-rate <Hz>   emission callbacks per second (default\n"
+         "                         1000)\n"
+         "  --hand <synthetic|sway|file.rwh>\n"
+         "                         a still or swaying synthetic hand, or a\n"
+         "                         hand recording looped on the emitter\n"
+         "                         clock (default sway)\n"
+         "  --seed <n>             trial order seed\n"
+         "  --record <path>        write the emitted samples as CSV\n";
+}
+
+// Returns 0 on success, 1 on invalid arguments
+int parse_options(int argc, char* argv[], Options& options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    auto value = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        throw "Missing value for " + arg;
+      }
+      return argv[++i];
+    };
+    try {
+      if (arg == "--callback") {
+        options.callback = value();
+      } else if (arg == "--speed") {
+        options.speed = std::stod(value());
+      } else if (arg == "--seconds") {
+        options.seconds = std::stod(value());
+      } else if (arg == "--trial-ms") {
+        options.trial_ms = std::stod(value());
+      } else if (arg == "--control-points") {
+        options.control_points = std::stoul(value());
+      } else if (arg == "--callback-rate") {
+        options.callback_rate = std::stof(value());
+      } else if (arg == "--hand") {
+        options.hand = value();
+      } else if (arg == "--seed") {
+        options.seed = std::stoull(value());
+      } else if (arg == "--record") {
+        options.record = value();
+      } else {
+        std::cout << "Unknown argument: " << arg << std::endl;
+        return 1;
+      }
+    } catch (const std::string& message) {
+      std::cout << message << std::endl;
+      return 1;
+    } catch (const std::exception&) {
+      std::cout << "Invalid value for " << arg << std::endl;
+      return 1;
+    }
+  }
+  if (options.callback != "slot" && options.callback != "look-ahead" &&
+      options.callback != "composite") {
+    std::cout << "Unknown callback: " << options.callback << std::endl;
+    return 1;
+  }
+  if (options.speed < 0 || options.seconds <= 0 || options.trial_ms <= 0 ||
+      options.control_points == 0 || options.callback_rate <= 0) {
+    std::cout << "Seconds, trial length, control points and callback rate "
+                 "must be positive"
+              << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+// Feeds a synthetic hand to the listeners in place of the Leap controller,
+// at the Leap frame rate on the clock of the emitter. All frames are pushed
+// under one lock, so each listener has one writer at a time. After replay()
+// a hand recording is played instead.
+class HandFeeder {
+ public:
+  HandFeeder(const Emitter& emitter, float sway, double frame_rate = 110.0)
+      : _emitter(emitter),
+        _hand(sway),
+        _period(duration_from_sec(1.0 / frame_rate)) {}
+  ~HandFeeder() { stop(); }
+
+  // Plays the recording at path in a loop. Returns false after printing the
+  // reason if it could not be read.
+  bool replay(const std::string& path) {
+    std::vector<HandTracking::RecordedFrame> frames;
+    if (!HandTracking::load_recording(path, frames)) {
+      return false;
+    }
+    HandTracking::HandReplay::Options options;
+    options.loop = true;
+    options.clock = [this] { return _emitter.now(); };
+    _replay = std::make_unique<HandTracking::HandReplay>(std::move(frames),
+                                                         std::move(options));
+    return true;
+  }
+
+  // Adds listener, it gets the hand of the current time right away
+  void listen(HandTracking::LeapListening& listener) {
+    if (_replay) {
+      _replay->listen(listener);
+      return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    LocalTimePoint now = _emitter.now();
+    listener.push({now, _hand.at(duration_to_sec(now - _origin))});
+    _listeners.push_back(&listener);
+  }
+  void unlisten(HandTracking::LeapListening& listener) {
+    if (_replay) {
+      _replay->unlisten(listener);
+      return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    _listeners.erase(
+        std::remove(_listeners.begin(), _listeners.end(), &listener),
+        _listeners.end());
+  }
+
+  void start() {
+    if (_replay) {
+      _replay->start();
+      return;
+    }
+    _running = true;
+    _thread = std::thread(&HandFeeder::run, this);
+  }
+  void stop() {
+    if (_replay) {
+      _replay->stop();
+    }
+    if (_running.exchange(false)) {
+      _thread.join();
+    }
+  }
+
+ private:
+  const Emitter& _emitter;
+  Offline::SyntheticHand _hand;
+  const LocalDuration _period;
+  const LocalTimePoint _origin = _emitter.now();
+  std::unique_ptr<HandTracking::HandReplay> _replay;
+  std::mutex _mutex;
+  std::vector<HandTracking::LeapListening*> _listeners;
+  std::thread _thread;
+  std::atomic<bool> _running{false};
+
+  void run() {
+    LocalTimePoint next = _emitter.now();
+    while (_running) {
+      if (_emitter.now() < next) {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        continue;
+      }
+      std::lock_guard<std::mutex> lock(_mutex);
+      HandTracking::HandFrame frame{
+          next, _hand.at(duration_to_sec(next - _origin))};
+      for (HandTracking::LeapListening* listener : _listeners) {
+        listener->push(frame);
+      }
+      next += _period;
+    }
+  }
+};
+
+// Sleeps until the emitter reaches time
+void wait_for(const Emitter& emitter, const LocalTimePoint& time) {
+  while (emitter.now() < time) {
+    std::this_thread::sleep_for(std::chrono::microseconds(500));
+  }
+}
+
+// The deadlines the callback missed on the clock of the emitter, then the
+// callback timings on the wall clock
+// The deadlines are only printed at real time, as fast as possible they are
+// met or missed by as much as the emitter runs ahead
+void print_results(const Options& options,
+                   const Emitter& emitter,
+                   Instrumentation::InstrumentedCallback& instrumented) {
+  const bool deadlines = options.speed > 0;
+  std::cout << "Emitter: " << emitter.getCallbackIterations().value()
+            << " intervals";
+  if (deadlines) {
+    std::cout << ", " << emitter.getMissedCallbackIterations().value()
+              << " past the submission deadline";
+  }
+  std::cout << std::endl;
+  instrumented.stats.print(std::cout, deadlines);
+}
+
+// Switches the random walk configurations through a ConfigurationSlot every
+// trial, optionally rendered ahead by a LookAhead producer
+int run_trials(const Options& options,
+               Emitter& emitter,
+               HandFeeder& feeder,
+               Instrumentation::InstrumentedCallback& instrumented) {
+  Configurations::Configurations configurations;
+  Utils::TrialSampler sampler =
+      options.seed
+          ? Utils::TrialSampler(configurations.size(), options.seed.value())
+          : Utils::TrialSampler(configurations.size());
+  std::cout << "Trial order seed: " << sampler.seed() << std::endl;
+
+  Parameters::Engine::ConfigurationSlot slot;
+  Parameters::Engine::LookAhead producer(slot);
+  const bool look_ahead = options.callback == "look-ahead";
+
+  auto next_configuration = [&]() -> Parameters::Configuration* {
+    size_t index = sampler.next();
+    Parameters::Configuration* next = configurations.build_next(index);
+    next->reset_playtime();
+    feeder.listen(next->hand);
+    return next;
+  };
+
+  Parameters::Configuration* point = next_configuration();
+  if (!slot.set(point)) {
+    std::cout << "No renderer for the first trial" << std::endl;
+    return 1;
+  }
+  if (look_ahead) {
+    instrumented.wrap(Parameters::Engine::LookAhead::emitter_callback<
+                          Emitter, Interval>,
+                      &producer);
+    producer.start();
+  } else {
+    instrumented.wrap(Parameters::Engine::ConfigurationSlot::emitter_callback<
+                          Emitter, Interval>,
+                      &slot);
+  }
+
+  feeder.start();
+  emitter.start();
+  const LocalTimePoint start = emitter.now();
+  const LocalTimePoint end = start + duration_from_sec(options.seconds);
+  const LocalDuration trial = duration_from_sec(options.trial_ms / 1000);
+
+  size_t trials = 1;
+  int ok = 0;
+  for (LocalTimePoint switch_at = start + trial; switch_at < end;
+       switch_at += trial) {
+    wait_for(emitter, switch_at);
+    Parameters::Configuration* next = next_configuration();
+    if (!slot.stage(next)) {
+      std::cout << "Failed to stage trial " << trials << std::endl;
+      ok = 1;
+      break;
+    }
+    Parameters::Configuration* previous = slot.reclaim();
+    if (previous == nullptr) {
+      std::cout << "Emitter did not switch to trial " << trials << std::endl;
+      ok = 1;
+      break;
+    }
+    feeder.unlisten(previous->hand);
+    configurations.release(previous);
+    trials++;
+  }
+  if (ok == 0) {
+    wait_for(emitter, end);
+  }
+
+  emitter.stop();
+  producer.stop();
+  feeder.stop();
+  configurations.release();
+
+  std::cout << "Trials: " << trials << std::endl;
+  if (look_ahead) {
+    std::cout << "Look-ahead hits: " << producer.hits()
+              << ", misses: " << producer.misses() << std::endl;
+  }
+  print_results(options, emitter, instrumented);
+  return ok;
+}
+
+// Streams the configurations of the composite entry, a ripple and points
+// tracking the finger tips, on up to control_points control points
+int run_composite(const Options& options,
+                  Emitter& emitter,
+                  HandFeeder& feeder,
+                  Instrumentation::InstrumentedCallback& instrumented) {
+  Parameters::Ripple ripple(1.f, 256, 100000,
+                            Ultrahaptics::Vector3(-20.f, 0.f, 0.f), 50,
+                            std::make_tuple(50, 200), 10.f);
+  std::vector<std::unique_ptr<Parameters::TrackedPoint>> tips;
+  for (int finger = (int)Parameters::FingerIdx::INDEX;
+       finger <= (int)Parameters::FingerIdx::PINKY; finger++) {
+    tips.push_back(std::make_unique<Parameters::TrackedPoint>(
+        1.f, 128, 100000, Ultrahaptics::Vector3(0.f, 0.f, 0.f),
+        (Parameters::FingerIdx)finger, Parameters::BoneIdx::TIP));
+  }
+
+  Parameters::Engine::Compositor compositor;
+  compositor.add(&ripple);
+  for (size_t k = 1; k < options.control_points && k <= tips.size(); k++) {
+    compositor.add(tips[k - 1].get());
+  }
+  if (compositor.negotiate(emitter) > 0) {
+    return 1;
+  }
+  feeder.listen(compositor.hand);
+  instrumented.wrap(
+      Parameters::Engine::Compositor::emitter_callback<Emitter, Interval>,
+      &compositor);
+
+  feeder.start();
+  emitter.start();
+  wait_for(emitter, emitter.now() + duration_from_sec(options.seconds));
+  emitter.stop();
+  feeder.stop();
+
+  print_results(options, emitter, instrumented);
+  return 0;
+}
+
+int run(const Options& options) {
+  Emitter::Options emitter_options;
+  emitter_options.speed = options.speed;
+  emitter_options.callback_rate = options.callback_rate;
+  emitter_options.record = !options.record.empty();
+  Emitter emitter(emitter_options);
+
+  auto add_res = emitter.addDevice();
+  if (!add_res) {
+    std::cout << "Failed to add device: " << add_res.error().message()
+              << std::endl;
+    return 1;
+  }
+  auto cp_res =
+      emitter.setControlPointCount(1, Ultraleap::Haptics::AdjustRate::All);
+  if (!cp_res) {
+    std::cout << "Failed to setControlPointCount: "
+              << cp_res.error().message() << std::endl;
+    return 1;
+  }
+
+  Instrumentation::InstrumentedCallback instrumented;
+  emitter.setEmissionCallback(
+      Instrumentation::InstrumentedCallback::emitter_callback<Emitter,
+                                                              Interval>,
+      &instrumented);
+  HandFeeder feeder(emitter, options.hand == "sway" ? 30.f : 0.f);
+  if (options.hand != "synthetic" && options.hand != "sway" &&
+      !feeder.replay(options.hand)) {
+    return 1;
+  }
+
+  int ok = options.callback == "composite"
+               ? run_composite(options, emitter, feeder, instrumented)
+               : run_trials(options, emitter, feeder, instrumented);
+
+  if (ok == 0 && !options.record.empty()) {
+    std::ofstream out(options.record);
+    if (!out) {
+      std::cout << "Failed to open recording: " << options.record
+                << std::endl;
+      return 1;
+    }
+    emitter.write_csv(out);
+    std::cout << "Recorded " << emitter.recorded().size() << " samples to "
+              << options.record << std::endl;
+  }
+  return ok;
+}
+}  // namespace RandomWalk::LoadTest
+
+int main(int argc, char* argv[]) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--help") {
+      RandomWalk::LoadTest::print_usage();
+      return 0;
+    }
+  }
+  RandomWalk::LoadTest::Options options;
+  if (RandomWalk::LoadTest::parse_options(argc, argv, options) > 0) {
+    RandomWalk::LoadTest::print_usage();
+    return 1;
+  }
+  return RandomWalk::LoadTest::run(options);
+}
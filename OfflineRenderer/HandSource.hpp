@@ -0,0 +1,198 @@
+#pragma once
+
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "HandRecording.hpp"
+#include "HandTracking.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323
+#endif
+
+namespace RandomWalk::Offline {
+using HandTracking::LeapOutput;
+
+// A vector of a LeapOutput, a member or a bone center
+struct HandField {
+  std::string name;
+  Ultrahaptics::Vector3 LeapOutput::*member = nullptr;
+  int finger = 0;
+  int bone = 0;
+
+  Ultrahaptics::Vector3& of(LeapOutput& hand) const {
+    return member != nullptr ? hand.*member : hand.bones[finger][bone];
+  }
+};
+
+// Vector fields of a LeapOutput in the column order of a hand recording
+inline const std::vector<HandField>& hand_fields() {
+  static const std::vector<HandField> fields = [] {
+    std::vector<HandField> fields = {
+        {"palm_position", &LeapOutput::palm_position},
+        {"palm_direction", &LeapOutput::palm_direction},
+        {"palm_normal", &LeapOutput::palm_normal},
+        {"wrist_position", &LeapOutput::wrist_position},
+    };
+    const char* fingers[5] = {"thumb", "index", "middle", "ring", "pinky"};
+    // roots, intermediates, proximals, then tips
+    const std::pair<const char*, int> bones[4] = {
+        {"root", 0}, {"intermediate", 2}, {"proximal", 1}, {"tip", 3}};
+    for (auto& [bone_name, bone] : bones) {
+      for (int finger = 0; finger < 5; finger++) {
+        fields.push_back({std::string("finger_") + bone_name + "_" +
+                              fingers[finger],
+                          nullptr, finger, bone});
+      }
+    }
+    return fields;
+  }();
+  return fields;
+}
+
+// Hand data for the offline renderer, queried once per rendered interval
+class HandSource {
+ public:
+  virtual ~HandSource() = default;
+  virtual LeapOutput at(double seconds) = 0;
+};
+
+// A right hand held flat 200mm above the array, fingers pointing away from
+// the user. With sway > 0 the palm moves sideways by sway mm at 0.5 Hz.
+class SyntheticHand : public HandSource {
+ public:
+  SyntheticHand(float sway = 0.f) : _sway(sway) {
+    _hand.palm_position = Ultrahaptics::Vector3(0.f, 200.f, 0.f);
+    _hand.palm_direction = Ultrahaptics::Vector3(0.f, 0.f, -1.f);
+    _hand.palm_normal = Ultrahaptics::Vector3(0.f, 1.f, 0.f);
+    _hand.wrist_position = Ultrahaptics::Vector3(0.f, 200.f, 50.f);
+
+    // finger x positions from thumb to pinky and the z of each bone center
+    const float xs[5] = {-45.f, -22.f, 0.f, 20.f, 38.f};
+    const float roots[5] = {20.f, 0.f, 0.f, 0.f, 5.f};
+    const float proximals[5] = {-15.f, -50.f, -52.f, -48.f, -38.f};
+    const float intermediates[5] = {-40.f, -80.f, -85.f, -78.f, -63.f};
+    const float tips[5] = {-60.f, -100.f, -106.f, -98.f, -80.f};
+    for (int f = 0; f < 5; f++) {
+      _hand.bones[f][0] = Ultrahaptics::Vector3(xs[f], 200.f, roots[f]);
+      _hand.bones[f][1] = Ultrahaptics::Vector3(xs[f], 200.f, proximals[f]);
+      _hand.bones[f][2] =
+          Ultrahaptics::Vector3(xs[f], 200.f, intermediates[f]);
+      _hand.bones[f][3] = Ultrahaptics::Vector3(xs[f], 200.f, tips[f]);
+    }
+    _hand.hand_present = true;
+    _hand.hand_is_left = false;
+  }
+
+  LeapOutput at(double seconds) override {
+    if (_sway <= 0.f) {
+      return _hand;
+    }
+    LeapOutput hand = _hand;
+    Ultrahaptics::Vector3 shift(
+        _sway * (float)std::sin(2 * M_PI * 0.5 * seconds), 0.f, 0.f);
+    for (auto& field : hand_fields()) {
+      field.of(hand) += shift;
+    }
+    return hand;
+  }
+
+ private:
+  float _sway;
+  LeapOutput _hand;
+};
+
+// Replays a hand recording. The CSV file has a header line and one row per
+// tracking frame: time in seconds, hand_present, hand_is_left, then x, y, z
+// of every field in hand_fields() order. The frame at or before the queried
+// time is returned, times past the end hold the last frame.
+class RecordedHand : public HandSource {
+ public:
+  // Returns false and prints the reason if path could not be read. Binary
+  // recordings of the hand recorder end in .rwh, others are read as CSV.
+  bool load(const std::string& path) {
+    if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".rwh") == 0) {
+      return load_binary(path);
+    }
+    std::ifstream file(path);
+    if (!file) {
+      std::cout << "Failed to open hand recording: " << path << std::endl;
+      return false;
+    }
+    std::string line;
+    std::getline(file, line);
+    while (std::getline(file, line)) {
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+      std::stringstream row(line);
+      std::vector<double> values;
+      std::string cell;
+      // A trailing comma or a cell that is not a number makes the row invalid
+      bool valid = line.empty() || line.back() != ',';
+      while (valid && std::getline(row, cell, ',')) {
+        size_t end = 0;
+        try {
+          values.push_back(std::stod(cell, &end));
+        } catch (const std::exception&) {
+          end = 0;
+        }
+        valid = end != 0 && end == cell.size();
+      }
+      if (!valid || values.size() != 3 + 3 * hand_fields().size()) {
+        std::cout << "Malformed hand recording row: " << line << std::endl;
+        return false;
+      }
+      LeapOutput hand;
+      hand.hand_present = values[1] != 0;
+      hand.hand_is_left = values[2] != 0;
+      size_t column = 3;
+      for (auto& field : hand_fields()) {
+        field.of(hand) = Ultrahaptics::Vector3((float)values[column],
+                                               (float)values[column + 1],
+                                               (float)values[column + 2]);
+        column += 3;
+      }
+      _times.push_back(values[0]);
+      _frames.push_back(hand);
+    }
+    if (_frames.empty()) {
+      std::cout << "Empty hand recording: " << path << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  LeapOutput at(double seconds) override {
+    // queries are increasing, continue from the last frame
+    if (_current > 0 && _times[_current] > seconds) {
+      _current = 0;
+    }
+    while (_current + 1 < _times.size() && _times[_current + 1] <= seconds) {
+      _current++;
+    }
+    return _frames[_current];
+  }
+
+ private:
+  std::vector<double> _times;
+  std::vector<LeapOutput> _frames;
+  size_t _current = 0;
+
+  bool load_binary(const std::string& path) {
+    std::vector<HandTracking::RecordedFrame> recorded;
+    if (!HandTracking::load_recording(path, recorded)) {
+      return false;
+    }
+    for (const auto& frame : recorded) {
+      _times.push_back((frame.timestamp - recorded.front().timestamp) * 1e-6);
+      _frames.push_back(frame.output());
+    }
+    return true;
+  }
+};
+}  // namespace RandomWalk::Offline
@@ -0,0 +1,316 @@
+// Headless renderer for the random walk configurations and sensation trials.
+// Drives the configurations through the same Engine::render path as the
+// emitter callback, on a simulated sample clock, and writes the resulting
+// position/intensity stream to a trace. Needs neither an array nor a Leap
+// device, on Linux build with e.g.
+//   g++ -std=c++17 -O2 -I../Dependencies/Ultrahaptics3.0.0/include
+//       -I../Dependencies/Leap/include -I../KeyboardControlledStimuli
+//       OfflineRenderer.cpp ../KeyboardControlledStimuli/{Configurations,
+//       HandTracking,Modulation,SensationTrials,TrialPlan,Utils}.cpp -lLeap
+//       -pthread
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Configurations.h"
+#include "Engine.h"
+#include "HandSource.hpp"
+#include "SensationTrials.hpp"
+#include "Trace.hpp"
+#include "TrialGate.hpp"
+#include "TrialPlan.hpp"
+#include "TrialSampler.hpp"
+
+using namespace RandomWalk;
+
+namespace RandomWalk::Offline {
+
+struct Options {
+  std::string config = "all";
+  std::string sensations;
+  std::string hand = "synthetic";
+  std::string out = "trace.csv";
+  std::string compile_plan;
+  uint64_t plan_seeds = 0;
+  bool trace = true;
+  bool list = false;
+  double rate = 40000;
+  size_t interval = 64;
+  double seconds = 2;
+  double trial_ms = 4000;
+  std::optional<uint64_t> seed;
+};
+
+void print_usage() {
+  std::cout
+      << "Usage: OfflineRenderer [options]\n"
+         "  --list                 list the configuration keys\n"
+         "  --config <key|all>     configuration to render (default all)\n"
+         "  --sensations <path>    write the trial schedule of a sensation\n"
+         "                         configuration or trial plan instead\n"
+         "  --compile-plan <path>  compile the --sensations configuration\n"
+         "                         into a trial plan instead\n"
+         "  --plan-seeds <n>       pre-shuffle the plan for seeds 0 to n - 1\n"
+         "                         (default 0)\n"
+         "  --rate <Hz>            sample rate (default 40000)\n"
+         "  --interval <samples>   samples per emitter callback (default 64)\n"
+         "  --seconds <s>          rendered time per configuration (default "
+         "2)\n"
+         "  --hand <synthetic|sway|file.csv|file.rwh>\n"
+         "                         hand data, a still or swaying synthetic\n"
+         "                         hand or a hand recording\n"
+         "  --trial-ms <ms>        length of sensation trials without a\n"
+         "                         duration parameter (default 4000)\n"
+         "  --seed <n>             shuffle the sensation trials\n"
+         "  --out <path>           trace file, binary if it ends in .bin\n"
+         "                         (default trace.csv)\n"
+         "  --no-trace             only measure the rendering throughput\n";
+}
+
+// Returns 0 on success, 1 on invalid arguments
+int parse_options(int argc, char* argv[], Options& options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    auto value = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        throw "Missing value for " + arg;
+      }
+      return argv[++i];
+    };
+    try {
+      if (arg == "--list") {
+        options.list = true;
+      } else if (arg == "--config") {
+        options.config = value();
+      } else if (arg == "--sensations") {
+        options.sensations = value();
+      } else if (arg == "--compile-plan") {
+        options.compile_plan = value();
+      } else if (arg == "--plan-seeds") {
+        options.plan_seeds = std::stoull(value());
+      } else if (arg == "--rate") {
+        options.rate = std::stod(value());
+      } else if (arg == "--interval") {
+        options.interval = std::stoul(value());
+      } else if (arg == "--seconds") {
+        options.seconds = std::stod(value());
+      } else if (arg == "--hand") {
+        options.hand = value();
+      } else if (arg == "--trial-ms") {
+        options.trial_ms = std::stod(value());
+      } else if (arg == "--seed") {
+        options.seed = std::stoull(value());
+      } else if (arg == "--out") {
+        options.out = value();
+      } else if (arg == "--no-trace") {
+        options.trace = false;
+      } else {
+        std::cout << "Unknown argument: " << arg << std::endl;
+        return 1;
+      }
+    } catch (const std::string& message) {
+      std::cout << message << std::endl;
+      return 1;
+    } catch (const std::exception&) {
+      std::cout << "Invalid value for " << arg << std::endl;
+      return 1;
+    }
+  }
+  if (options.rate <= 0 || options.interval == 0 || options.seconds <= 0) {
+    std::cout << "Rate, interval and seconds must be positive" << std::endl;
+    return 1;
+  }
+  if (!options.compile_plan.empty() && options.sensations.empty()) {
+    std::cout << "--compile-plan needs --sensations" << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+std::unique_ptr<HandSource> make_hand(const std::string& hand) {
+  if (hand == "synthetic") {
+    return std::make_unique<SyntheticHand>();
+  }
+  if (hand == "sway") {
+    return std::make_unique<SyntheticHand>(30.f);
+  }
+  auto recorded = std::make_unique<RecordedHand>();
+  if (!recorded->load(hand)) {
+    return nullptr;
+  }
+  return recorded;
+}
+
+// Renders the configurations of the registry back to back on one sample clock
+int render_configurations(const Options& options) {
+  Configurations::Configurations configurations;
+
+  std::vector<size_t> indices;
+  for (int i = 0; i < configurations.size(); i++) {
+    if (options.config == "all" ||
+        configurations.get_key(i) == options.config) {
+      indices.push_back(i);
+    }
+  }
+  if (indices.empty()) {
+    std::cout << "Unknown configuration: " << options.config << std::endl;
+    return 1;
+  }
+
+  auto hand = make_hand(options.hand);
+  if (!hand) {
+    return 1;
+  }
+
+  std::unique_ptr<Trace> trace;
+  if (options.trace) {
+    bool binary = options.out.size() >= 4 &&
+                  options.out.compare(options.out.size() - 4, 4, ".bin") == 0;
+    if (binary) {
+      trace = std::make_unique<BinaryTrace>(options.out);
+    } else {
+      trace = std::make_unique<CsvTrace>(options.out);
+    }
+    if (!trace->good()) {
+      std::cout << "Failed to open trace: " << options.out << std::endl;
+      return 1;
+    }
+  }
+
+  const int64_t samples = std::llround(options.seconds * options.rate);
+  int64_t first = 0;
+  std::chrono::nanoseconds total_time(0);
+  for (size_t t = 0; t < indices.size(); t++) {
+    std::string key = configurations.get_key(indices[t]);
+    Parameters::Configuration* config = configurations.build(indices[t]);
+    auto render = Parameters::Engine::render_for(config);
+    if (render == nullptr) {
+      std::cout << "No renderer for " << key << std::endl;
+      return 1;
+    }
+
+    std::chrono::nanoseconds render_time(0);
+    for (int64_t done = 0; done < samples;) {
+      size_t n = (size_t)std::min<int64_t>(options.interval, samples - done);
+      HandTracking::HandMotion motion(hand->at((double)first / options.rate));
+
+      auto start = std::chrono::steady_clock::now();
+      render(config, motion, first, options.rate, n);
+      render_time += std::chrono::steady_clock::now() - start;
+
+      if (trace) {
+        trace->write(key, config->block);
+      }
+      first += n;
+      done += n;
+    }
+    total_time += render_time;
+
+    std::cout << t << "\t" << key << "\t"
+              << (double)render_time.count() / samples << " ns/sample"
+              << std::endl;
+  }
+  configurations.release();
+
+  double rendered = (double)samples * indices.size();
+  std::cout << "Rendered " << (int64_t)rendered << " samples at "
+            << options.rate << " Hz, " << total_time.count() / rendered
+            << " ns/sample, "
+            << rendered / options.rate / (total_time.count() * 1e-9)
+            << "x real time" << std::endl;
+  return 0;
+}
+
+// The sensation output is computed by the sensation engine of the haptics
+// service, which is not available offline. Writes the trial schedule
+// instead, one row per window in which the emitter plays: the trials in
+// order, each for its duration, with the meta_frequency gating the
+// sensations apply at the sample clock.
+int render_sensation_schedule(const Options& options) {
+  Sensations::TrialPlan plan;
+  if (plan.open(options.sensations) > 0) {
+    return 1;
+  }
+  const Sensations::SensationTrials& trials = plan.trials();
+
+  std::vector<size_t> order(trials.size());
+  std::iota(order.begin(), order.end(), size_t(0));
+  if (options.seed) {
+    order = plan.order(options.seed.value());
+  }
+
+  std::ofstream out(options.out);
+  if (!out) {
+    std::cout << "Failed to open trace: " << options.out << std::endl;
+    return 1;
+  }
+  out << "trial,key,sensation,on,off\n";
+
+  double start = 0;
+  for (size_t t = 0; t < order.size(); t++) {
+    const Sensations::sensation trial = trials.trial(order[t]);
+    const std::string key = trials.key(order[t]);
+    const Sensations::parameters& params = std::get<2>(trial);
+
+    const Sensations::TrialGate gate =
+        Sensations::TrialGate::of(params, options.trial_ms);
+    for (size_t w = 0; w < gate.on_windows(); w++) {
+      auto [on, off] = gate.on_window(w);
+      out << t << ',' << key << ',' << std::get<1>(trial) << ','
+          << (start + on) / 1000 << ',' << (start + off) / 1000 << '\n';
+    }
+    start += gate.duration;
+  }
+  std::cout << order.size() << " trials, " << start / 1000 << " s" << std::endl;
+  return 0;
+}
+
+// Compiles the sensation configuration into a trial plan, pre-shuffled for
+// the seeds of the sessions to come
+int compile_plan(const Options& options) {
+  Sensations::TrialPlan plan;
+  if (plan.open(options.sensations) > 0) {
+    return 1;
+  }
+  std::vector<uint64_t> seeds(options.plan_seeds);
+  std::iota(seeds.begin(), seeds.end(), uint64_t(0));
+  if (Sensations::compile_trial_plan(plan.trials(), seeds,
+                                     options.compile_plan) > 0) {
+    return 1;
+  }
+  std::cout << "Compiled " << plan.trials().size() << " trials and "
+            << seeds.size() << " trial orders to " << options.compile_plan
+            << std::endl;
+  return 0;
+}
+}  // namespace RandomWalk::Offline
+
+int main(int argc, char* argv[]) {
+  Offline::Options options;
+  if (Offline::parse_options(argc, argv, options) > 0) {
+    Offline::print_usage();
+    return 1;
+  }
+
+  if (options.list) {
+    Configurations::Configurations configurations;
+    for (auto& key : configurations.get_keys(true)) {
+      std::cout << key << std::endl;
+    }
+    return 0;
+  }
+  if (!options.compile_plan.empty()) {
+    return Offline::compile_plan(options);
+  }
+  if (!options.sensations.empty()) {
+    return Offline::render_sensation_schedule(options);
+  }
+  return Offline::render_configurations(options);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#include "Parameters.h"
+
+namespace RandomWalk::Offline {
+
+// Destination of the rendered position/intensity stream
+class Trace {
+ public:
+  virtual ~Trace() = default;
+  virtual bool good() const = 0;
+  // Appends the samples of a rendered block of the named trial
+  virtual void write(const std::string& trial,
+                     const Parameters::SampleBlock& block) = 0;
+};
+
+// One line per sample: trial, sample index, time in seconds, x, y, z, intensity
+class CsvTrace : public Trace {
+ public:
+  CsvTrace(const std::string& path) : _file(path) {
+    _file << "trial,sample,time,x,y,z,intensity\n";
+  }
+  bool good() const override { return _file.good(); }
+  void write(const std::string& trial,
+             const Parameters::SampleBlock& block) override {
+    for (size_t i = 0; i < block.size; i++) {
+      _file << trial << ',' << block.index(i) << ','
+            << (double)block.index(i) / block.rate << ',' << block.x[i] << ','
+            << block.y[i] << ',' << block.z[i] << ',' << block.intensity[i]
+            << '\n';
+    }
+  }
+
+ private:
+  std::ofstream _file;
+};
+
+// Little-endian records after an 8 byte "RWTRACE1" magic: per block the
+// trial index (uint32), sample count n (uint32), first sample index (int64)
+// and sample rate (double), followed by n floats each of x, y, z and
+// intensity. Trial names are listed in the renderer output.
+class BinaryTrace : public Trace {
+ public:
+  BinaryTrace(const std::string& path) : _file(path, std::ios::binary) {
+    _file.write("RWTRACE1", 8);
+  }
+  bool good() const override { return _file.good(); }
+  void write(const std::string& trial,
+             const Parameters::SampleBlock& block) override {
+    if (trial != _trial) {
+      _trial = trial;
+      _trial_index = _trials++;
+    }
+    uint32_t n = (uint32_t)block.size;
+    _file.write(reinterpret_cast<const char*>(&_trial_index),
+                sizeof(_trial_index));
+    _file.write(reinterpret_cast<const char*>(&n), sizeof(n));
+    _file.write(reinterpret_cast<const char*>(&block.first),
+                sizeof(block.first));
+    _file.write(reinterpret_cast<const char*>(&block.rate), sizeof(block.rate));
+    for (auto* values : {&block.x, &block.y, &block.z, &block.intensity}) {
+      _file.write(reinterpret_cast<const char*>(values->data()),
+                  n * sizeof(float));
+    }
+  }
+
+ private:
+  std::ofstream _file;
+  std::string _trial;
+  uint32_t _trial_index = 0;
+  uint32_t _trials = 0;
+};
+}  // namespace RandomWalk::Offline
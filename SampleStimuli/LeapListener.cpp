@@ -59,16 +59,16 @@ public:
 			local_hand_data.hand_present = true;
 		}
 
-		atomic_local_hand_data.store(local_hand_data);
+		hand_data.publish(local_hand_data);
 	}
 
 	LeapOutput getLeapOutput()
 	{
-		return atomic_local_hand_data.load();
+		return hand_data.read();
 	}
 
 private:
-	std::atomic <LeapOutput> atomic_local_hand_data;
+	RandomWalk::HandTracking::TripleBuffer<LeapOutput> hand_data;
 	Ultrahaptics::Alignment alignment;
 };
 
@@ -3,6 +3,8 @@
 #include <Leap.h>
 #include <Ultrahaptics.hpp>
 
+#include "../KeyboardControlledStimuli/TripleBuffer.hpp"
+
 #ifndef LEAPLISTENER_H 
 #define LEAPLISTENER_H
 // Structure to represent output from the Leap listener
@@ -53,14 +55,15 @@ public:
 			local_hand_data.hand_present = true;
 		}
 
-		atomic_local_hand_data.store(local_hand_data);
+		hand_data.publish(local_hand_data);
 	}
+	// Wait-free, read by the emitter callback only
 	LeapOutput getLeapOutput() {
-		return atomic_local_hand_data.load();
+		return hand_data.read();
 	}
 
 private:
-    std::atomic <LeapOutput> atomic_local_hand_data;
+    RandomWalk::HandTracking::TripleBuffer<LeapOutput> hand_data;
     Ultrahaptics::Alignment alignment;
 };
 